@@ -1,29 +1,33 @@
+#include <iomanip>
 #include <iostream>
+#include <limits>
 
 #include <mpi.h>
 
+#include "harmonic_engine.hh"
+
 int main(int ac, char **av) {
-  if (ac < 2) {
-    std::cout << "USAGE: " << av[0] << " N" << std::endl;
+  HarmonicOptions opts{};
+  if (!parseHarmonicOptions(ac, av, 1, opts)) {
+    std::cout << "USAGE: " << av[0] << " " << HARMONIC_USAGE << std::endl;
     return 0;
   }
 
-  double result = 0;
-  auto N = atoi(av[1]);
-
   MPI::Init(ac, av);
 
-  double partialSum = 0;
-  auto ncpus = MPI::COMM_WORLD.Get_size();
-  for (auto n = MPI::COMM_WORLD.Get_rank() + 1; n <= N; n += ncpus) {
-    partialSum += 1.0 / n;
+  HarmonicResult result{};
+  {
+    Topology topo{MPI::COMM_WORLD};
+    result = harmonicDistributed(opts, topo);
   }
 
-  MPI::COMM_WORLD.Reduce(&partialSum, &result, 1, MPI::DOUBLE, MPI::SUM, 0);
-
   if (0 == MPI::COMM_WORLD.Get_rank()) {
-    std::cout << "N = " << N << std::endl;
-    std::cout << "sum = " << result << std::endl;
+    std::cout << "N = " << indexString(opts.N) << std::endl;
+    std::cout << "sum = "
+              << std::setprecision(std::numeric_limits<double>::max_digits10)
+              << result.sum << std::endl;
+    std::cout << "error bound = " << std::setprecision(3) << result.bound
+              << std::endl;
   }
 
   MPI::Finalize();
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <utility>
+
+#include <gmpxx.h>
+#include <mpi.h>
+
+#include "transfer.hh"
+#include "tree_reduce.hh"
+
+// Binary splitting of the series for e. For a < b
+//
+//   P(a, b) / Q(a, b) = sum_{k = a + 1}^{b} 1 / ((a + 1) * (a + 2) * ... * k),
+//   Q(a, b) = (a + 1) * (a + 2) * ... * b,
+//
+// so that e = 1 + P(0, n) / Q(0, n) up to the terms left out. Two adjacent
+// ranges [a, m) and [m, b) combine as
+//
+//   P(a, b) = P(a, m) * Q(m, b) + P(m, b),   Q(a, b) = Q(a, m) * Q(m, b),
+//
+// and splitting a range in halves keeps the factors of every product of
+// about the same size, where GMP's fast multiplication pays off. One
+// division at the very end replaces the per-rank divisions.
+
+struct SeriesPQ {
+  mpz_class p = 0;
+  mpz_class q = 1;
+};
+
+// Below this many terms a range is summed by a plain loop of word-sized
+// multiplications
+constexpr long SPLIT_LEAF = 32;
+
+// x followed by y, i.e. x = [a, m) and y = [m, b) give [a, b)
+inline void combine(SeriesPQ &x, const SeriesPQ &y) {
+  x.p *= y.q;
+  x.p += y.p;
+  x.q *= y.q;
+}
+
+inline SeriesPQ splitRange(long a, long b) {
+  SeriesPQ res{};
+  if (b - a <= SPLIT_LEAF) {
+    for (auto k = a + 1; k <= b; k++) {
+      mpz_mul_ui(res.p.get_mpz_t(), res.p.get_mpz_t(), k);
+      res.p += 1;
+      mpz_mul_ui(res.q.get_mpz_t(), res.q.get_mpz_t(), k);
+    }
+    return res;
+  }
+
+  auto m = a + (b - a) / 2;
+  res = splitRange(a, m);
+  combine(res, splitRange(m, b));
+  return res;
+}
+
+// Combine the ranks' pairs, rank r holding the range right before rank
+// r + 1's, into the pair for the whole range on rank 0
+inline SeriesPQ reduceTree(SeriesPQ local, MPI::Intracomm &comm) {
+  constexpr int TAG_P = 1;
+  constexpr int TAG_Q = 2;
+  auto send = [&comm](const SeriesPQ &x, int dest) {
+    sendMpz(x.p, dest, TAG_P, comm);
+    sendMpz(x.q, dest, TAG_Q, comm);
+  };
+  auto recv = [&comm](int source) {
+    SeriesPQ x{};
+    x.p = recvMpz(source, TAG_P, comm);
+    x.q = recvMpz(source, TAG_Q, comm);
+    return x;
+  };
+  return reduceToRoot(std::move(local), send, recv, combine, comm);
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <gmpxx.h>
+#include <mpi.h>
+
+#include "transfer.hh"
+
+// Checkpoints of the per-process phase. Every process keeps its own file
+// in the checkpoint directory and rewrites it on its own schedule, so
+// checkpointing needs no synchronization; the processes only meet again
+// in the reductions that follow, which are not checkpointed. A file holds
+// a header naming the run and the process's interval, the position the
+// process has got to, and two integers (P and Q of the terms done, or
+// the partial sum and factorial of the chain) in the limb format of
+// transfer.hh. Files are written under a temporary name and renamed, so a
+// crash while writing leaves the previous checkpoint intact.
+
+struct CheckpointHeader {
+  char magic[4];
+  int engine;
+  long N;
+  int commSize;
+  int rank;
+  long start;
+  long end;
+  long next; // where to continue in [start, end)
+};
+
+constexpr char CHECKPOINT_MAGIC[4] = {'E', 'X', 'P', '1'};
+
+struct CheckpointState {
+  long next;
+  mpz_class x;
+  mpz_class y;
+};
+
+class Checkpointer {
+public:
+  // Collective: creates the directory. engine tells the engines apart, a
+  // checkpoint is due every period seconds, and load only finds one if
+  // resume is set.
+  Checkpointer(const char *dir, int engine, long N, double period,
+               bool resume, MPI::Intracomm &comm)
+      : engine_(engine), N_(N), period_(period), resume_(resume),
+        commSize_(comm.Get_size()), rank_(comm.Get_rank()) {
+    path_ = std::string{dir} + "/rank" + std::to_string(rank_) + ".ckpt";
+    if (rank_ == 0)
+      std::filesystem::create_directories(dir);
+    comm.Barrier();
+    last_ = MPI::Wtime();
+  }
+
+  bool due() const { return MPI::Wtime() - last_ >= period_; }
+  bool resumed() const { return resumed_; }
+
+  void save(long start, long end, const CheckpointState &state) {
+    CheckpointHeader header{};
+    std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.engine = engine_;
+    header.N = N_;
+    header.commSize = commSize_;
+    header.rank = rank_;
+    header.start = start;
+    header.end = end;
+    header.next = state.next;
+
+    auto tmp = path_ + ".tmp";
+    {
+      std::ofstream file{tmp, std::ios::binary | std::ios::trunc};
+      file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+      writeNumber(file, state.x);
+      writeNumber(file, state.y);
+      if (!file.flush())
+        return; // keep the previous checkpoint
+    }
+    std::rename(tmp.c_str(), path_.c_str());
+    last_ = MPI::Wtime();
+  }
+
+  // State saved by the same run configuration for the same interval
+  bool load(long start, long end, CheckpointState &state) {
+    if (!resume_)
+      return false;
+    std::ifstream file{path_, std::ios::binary};
+    CheckpointHeader header{};
+    if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)))
+      return false;
+    if (std::memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) ||
+        header.engine != engine_ || header.N != N_ ||
+        header.commSize != commSize_ || header.rank != rank_ ||
+        header.start != start || header.end != end)
+      return false;
+
+    state.next = header.next;
+    resumed_ = header.next >= start && header.next <= end &&
+               readNumber(file, state.x) && readNumber(file, state.y);
+    return resumed_;
+  }
+
+private:
+  static void writeNumber(std::ofstream &file, const mpz_class &num) {
+    auto buf = packMpz(num);
+    long size = buf.size();
+    file.write(reinterpret_cast<const char *>(&size), sizeof(size));
+    file.write(buf.data(), buf.size());
+  }
+
+  static bool readNumber(std::ifstream &file, mpz_class &num) {
+    long size{};
+    if (!file.read(reinterpret_cast<char *>(&size), sizeof(size)) ||
+        size < static_cast<long>(sizeof(MpzHeader)))
+      return false;
+    std::vector<char> buf(size);
+    if (!file.read(buf.data(), size))
+      return false;
+    MpzHeader header{};
+    std::memcpy(&header, buf.data(), sizeof(header));
+    if (sizeof(header) + std::labs(header.size) * sizeof(mp_limb_t) !=
+        buf.size())
+      return false;
+    num = unpackMpz(buf);
+    return true;
+  }
+
+  int engine_;
+  long N_;
+  double period_;
+  bool resume_;
+  bool resumed_ = false;
+  int commSize_;
+  int rank_;
+  std::string path_{};
+  double last_{};
+};
@@ -0,0 +1,302 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
+#include <gmpxx.h>
+#include <mpi.h>
+
+#include "binary_split.hh"
+#include "hypergeometric.hh"
+#include "partition.hh"
+
+// Constants the series engine computes, each as a hypergeometric series
+// (see hypergeometric.hh):
+//   e     - sum 1 / k!, by the e engine of binary_split.hh
+//   pi    - Chudnovsky: 426880 sqrt(10005) / pi =
+//           sum (-1)^k (6k)! (13591409 + 545140134 k) /
+//               ((3k)! (k!)^3 640320^(3k)), about 14 digits per term
+//   ln2   - 3/4 sum (-1)^k (k!)^2 / (2^k (2k + 1)!), about 0.9 digits per
+//           term
+//   exp   - e^x = sum x^k / k! for rational x = u / v; for x < 0 e^-x is
+//           summed and inverted, avoiding the cancellation of the
+//           alternating series
+//   sqrt  - sqrt(n) = r (1 - x) (1 - x)^(-1/2) for r = a / 2^20 just above
+//           sqrt(n) and x = 1 - n / r^2, with
+//           (1 - x)^(-1/2) = sum C(2k, k) (x / 4)^k, about 6 digits per term
+enum class Constant { E, Pi, Ln2, Exp, Sqrt };
+
+constexpr Constant ALL_CONSTANTS[] = {Constant::E, Constant::Pi,
+                                      Constant::Ln2, Constant::Exp,
+                                      Constant::Sqrt};
+
+struct ConstantSpec {
+  Constant kind = Constant::E;
+  long u = 1; // x = u / v for exp, n = u for sqrt
+  long v = 1;
+};
+
+// sqrt(n) = n * b * S / a for the series sum S with x = c / d
+struct SqrtSeed {
+  mpz_class a;
+  mpz_class b;
+  mpz_class c;
+  mpz_class d;
+};
+
+inline SqrtSeed sqrtSeed(long n) {
+  SqrtSeed seed{};
+  seed.b = 1 << 20;
+  mpz_class nb2 = seed.b * seed.b * n;
+  mpz_sqrt(seed.a.get_mpz_t(), nb2.get_mpz_t());
+  seed.a += 1;
+  seed.d = seed.a * seed.a;
+  seed.c = seed.d - nb2;
+  return seed;
+}
+
+// The seed of spec if it is a square root, computed once per evaluation and
+// handed to the functions below; empty for the other constants
+inline SqrtSeed constantSeed(const ConstantSpec &spec) {
+  return (spec.kind == Constant::Sqrt) ? sqrtSeed(spec.u) : SqrtSeed{};
+}
+
+inline const char *constantName(Constant kind) {
+  switch (kind) {
+  case Constant::E:
+    return "e";
+  case Constant::Pi:
+    return "pi";
+  case Constant::Ln2:
+    return "ln2";
+  case Constant::Exp:
+    return "exp";
+  case Constant::Sqrt:
+    return "sqrt";
+  }
+  return "unknown";
+}
+
+inline std::string specName(const ConstantSpec &spec) {
+  std::string name = constantName(spec.kind);
+  if (spec.kind == Constant::Exp || spec.kind == Constant::Sqrt) {
+    name += ':';
+    name += std::to_string(spec.u);
+  }
+  if (spec.kind == Constant::Exp) {
+    name += '/';
+    name += std::to_string(spec.v);
+  }
+  return name;
+}
+
+// e, pi, ln2, exp:u, exp:u/v or sqrt:n
+inline bool parseConstant(std::string_view name, ConstantSpec &spec) {
+  for (auto kind : ALL_CONSTANTS)
+    if (kind != Constant::Exp && kind != Constant::Sqrt &&
+        name == constantName(kind)) {
+      spec = {kind};
+      return true;
+    }
+
+  auto parseLong = [](std::string_view s, long &x) {
+    auto [end, err] = std::from_chars(s.data(), s.data() + s.size(), x);
+    return err == std::errc{} && end == s.data() + s.size();
+  };
+  constexpr std::string_view SQRT_PREFIX = "sqrt:";
+  if (name.substr(0, SQRT_PREFIX.size()) == SQRT_PREFIX) {
+    ConstantSpec res{Constant::Sqrt, 0, 1};
+    if (!parseLong(name.substr(SQRT_PREFIX.size()), res.u) || res.u <= 0)
+      return false;
+    spec = res;
+    return true;
+  }
+
+  constexpr std::string_view EXP_PREFIX = "exp:";
+  if (name.substr(0, EXP_PREFIX.size()) != EXP_PREFIX)
+    return false;
+  name.remove_prefix(EXP_PREFIX.size());
+  auto slash = std::min(name.find('/'), name.size());
+  ConstantSpec res{Constant::Exp, 0, 1};
+  if (!parseLong(name.substr(0, slash), res.u) ||
+      (slash < name.size() && !parseLong(name.substr(slash + 1), res.v)) ||
+      res.v <= 0)
+    return false;
+  spec = res;
+  return true;
+}
+
+// Terms [0, n) that bring the error below 10^-(N + 2)
+inline long termCount(const ConstantSpec &spec, const SqrtSeed &seed,
+                      long N) {
+  switch (spec.kind) {
+  case Constant::Pi:
+    return N / 14.18 + 2;
+  case Constant::Ln2:
+    return (N + 2) / std::log10(8.0) + 2;
+  case Constant::Sqrt:
+    return (N + 2) / -std::log10(seed.c.get_d() / seed.d.get_d()) + 2;
+  case Constant::E:
+  case Constant::Exp:
+    break;
+  }
+
+  // Smallest n past the peak with x^n / n! < 10^-(N + 2), by doubling and
+  // bisection on the logarithm
+  auto x = std::fabs(static_cast<double>(spec.u) / spec.v);
+  auto small = [&](long n) {
+    return n > x && n * std::log(x) - std::lgamma(n + 1.0) <
+                        -(N + 2) * std::log(10.0);
+  };
+  long hi = 1;
+  while (!small(hi))
+    hi *= 2;
+  long lo = hi / 2;
+  while (lo < hi) {
+    auto mid = lo + (hi - lo) / 2;
+    if (small(mid))
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  return lo;
+}
+
+// Estimated bits of P(0, k) and Q(0, k), the cost measure of partition.hh
+inline double seriesBits(const ConstantSpec &spec, const SqrtSeed &seed,
+                         long k) {
+  if (k <= 1)
+    return 0;
+  auto ln2 = std::log(2.0);
+  auto logFact = std::lgamma(k) / ln2; // (k - 1)!
+  switch (spec.kind) {
+  case Constant::E:
+    return logFact;
+  case Constant::Exp:
+    return (k - 1) * std::log2(std::max(1.0, std::fabs(1.0 * spec.u)) *
+                               spec.v) +
+           logFact;
+  case Constant::Pi:
+    return 6 * logFact + (k - 1) * std::log2(72 * 10939058860032000.0);
+  case Constant::Ln2:
+    return 2 * logFact + (k - 1) * 4;
+  case Constant::Sqrt:
+    return 2 * logFact + (k - 1) * (mpz_sizeinbase(seed.c.get_mpz_t(), 2) +
+                                    mpz_sizeinbase(seed.d.get_mpz_t(), 2));
+  }
+  return 0;
+}
+
+// Bits of precision for N decimals, plus those of the integer part
+inline long constantPrecision(const ConstantSpec &spec, long N) {
+  long prec = 64 + std::ceil(3.33 * N);
+  if (spec.kind == Constant::Exp)
+    prec += std::ceil(std::fabs(1.0 * spec.u / spec.v) / std::log(2.0));
+  else if (spec.kind == Constant::Sqrt)
+    prec += 32;
+  return prec;
+}
+
+// p(k), q(k) and a(k) of the series
+inline void seriesTerm(const ConstantSpec &spec, const SqrtSeed &seed,
+                       long k, mpz_class &p, mpz_class &q, mpz_class &a) {
+  p = 1;
+  q = 1;
+  a = 1;
+  if (k == 0) {
+    if (spec.kind == Constant::Pi)
+      a = 13591409;
+    return;
+  }
+
+  switch (spec.kind) {
+  case Constant::E:
+  case Constant::Exp:
+    p = std::labs(spec.u);
+    q = spec.v;
+    q *= k;
+    break;
+  case Constant::Pi:
+    p = -(6 * k - 5);
+    p *= 2 * k - 1;
+    p *= 6 * k - 1;
+    q = k;
+    q *= k;
+    q *= k;
+    q *= 10939058860032000ul; // 640320^3 / 24
+    a = 545140134;
+    a *= k;
+    a += 13591409;
+    break;
+  case Constant::Ln2:
+    p = -k;
+    q = 8 * k + 4;
+    break;
+  case Constant::Sqrt:
+    p = seed.c * (2 * k - 1);
+    q = seed.d * (2 * k);
+    break;
+  }
+}
+
+// The constant from Q(0, n) and T(0, n) at the default precision
+inline mpf_class finishConstant(const ConstantSpec &spec,
+                                const SqrtSeed &seed, const mpz_class &q,
+                                const mpz_class &t) {
+  mpf_class res = t;
+  res /= mpf_class{q};
+  switch (spec.kind) {
+  case Constant::E:
+    break;
+  case Constant::Exp:
+    if (spec.u < 0)
+      res = 1 / res;
+    break;
+  case Constant::Pi:
+    res = sqrt(mpf_class{10005}) * 426880 / res;
+    break;
+  case Constant::Ln2:
+    res *= 3;
+    res /= 4;
+    break;
+  case Constant::Sqrt:
+    res *= mpf_class{seed.b * spec.u};
+    res /= mpf_class{seed.a};
+    break;
+  }
+  return res;
+}
+
+// The constant to N decimals on rank 0, at the default precision, which
+// should be constantPrecision. Collective.
+inline mpf_class computeConstant(const ConstantSpec &spec, long N,
+                                 MPI::Intracomm &comm) {
+  auto commSize = comm.Get_size();
+  auto rank = comm.Get_rank();
+  auto seed = constantSeed(spec);
+  auto n = termCount(spec, seed, N);
+  auto bits = [&](long k) { return seriesBits(spec, seed, k); };
+  auto first = balancedBoundary(0, n, commSize, rank, bits);
+  auto last = balancedBoundary(0, n, commSize, rank + 1, bits);
+
+  if (spec.kind == Constant::E) {
+    // Term 0 is the 1 added at the end, term k >= 1 is k - 1 -> k there
+    auto local = splitRange(std::max(first, 1l) - 1, std::max(last, 1l) - 1);
+    auto total = reduceTree(std::move(local), comm);
+    if (rank != 0)
+      return {};
+    return finishConstant(spec, seed, total.q, total.p) + 1;
+  }
+
+  auto term = [&](long k, mpz_class &p, mpz_class &q, mpz_class &a) {
+    seriesTerm(spec, seed, k, p, q, a);
+  };
+  auto total = reduceSeries(splitSeries(first, last, term), comm);
+  if (rank != 0)
+    return {};
+  return finishConstant(spec, seed, total.q, total.t);
+}
@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <gmpxx.h>
+#include <mpi.h>
+
+#include "constants.hh"
+
+// Every constant at every digit count, one CSV row per run: time of the
+// distributed series evaluation up to the value on rank 0, time of the
+// conversion of that value to decimal on rank 0 alone, and digits per
+// second of the evaluation.
+
+struct BenchOptions {
+  std::vector<long> digits{};
+  std::vector<ConstantSpec> constants{{Constant::E},
+                                      {Constant::Pi},
+                                      {Constant::Ln2},
+                                      {Constant::Exp, 1, 3},
+                                      {Constant::Sqrt, 2}};
+  int repeat = 3;
+  const char *csv = nullptr; // stdout if not given
+};
+
+bool parseOptions(int ac, char **av, BenchOptions &opts);
+std::string runOnce(const ConstantSpec &spec, long N, int rep,
+                    MPI::Intracomm &comm);
+
+int main(int ac, char **av) {
+  MPI::Init(ac, av);
+  auto &comm = MPI::COMM_WORLD;
+  auto rank = comm.Get_rank();
+
+  BenchOptions opts{};
+  if (!parseOptions(ac, av, opts)) {
+    if (rank == 0)
+      std::cerr << "Usage: " << av[0]
+                << " digits1[,digits2,...] [--consts c1,c2,...]"
+                   " [--repeat N] [--csv file]\n"
+                   "constants: e pi ln2 exp:u/v sqrt:n"
+                << std::endl;
+    comm.Abort(1);
+  }
+
+  std::ofstream file{};
+  if (rank == 0 && opts.csv)
+    file.open(opts.csv);
+  std::ostream &out = (opts.csv) ? file : std::cout;
+  if (rank == 0)
+    out << "constant,procs,digits,terms,rep,compute,convert,digits_per_sec"
+        << std::endl;
+
+  for (auto &spec : opts.constants)
+    for (auto N : opts.digits)
+      for (int rep = 0; rep < opts.repeat; ++rep) {
+        auto row = runOnce(spec, N, rep, comm);
+        if (rank == 0)
+          out << row << std::endl;
+      }
+
+  MPI::Finalize();
+  return 0;
+}
+
+// Comma-separated list of items known to parse
+template <typename E, typename Parse>
+bool parseList(std::string_view list, std::vector<E> &items, Parse parse) {
+  items.clear();
+  while (!list.empty()) {
+    auto comma = std::min(list.find(','), list.size());
+    E item{};
+    if (!parse(list.substr(0, comma), item))
+      return false;
+    items.push_back(item);
+    list.remove_prefix(std::min(comma + 1, list.size()));
+  }
+  return !items.empty();
+}
+
+bool parseOptions(int ac, char **av, BenchOptions &opts) {
+  if (ac < 2)
+    return false;
+
+  auto parseDigits = [](std::string_view s, long &N) {
+    auto [end, err] = std::from_chars(s.data(), s.data() + s.size(), N);
+    return err == std::errc{} && end == s.data() + s.size() && N > 0;
+  };
+  if (!parseList(av[1], opts.digits, parseDigits))
+    return false;
+
+  for (int i = 2; i < ac; ++i) {
+    std::string_view arg = av[i];
+    if (i + 1 == ac)
+      return false;
+    std::string_view val = av[++i];
+    if (arg == "--consts" && parseList(val, opts.constants, parseConstant))
+      continue;
+    else if (arg == "--repeat")
+      opts.repeat = atoi(av[i]);
+    else if (arg == "--csv")
+      opts.csv = av[i];
+    else
+      return false;
+  }
+  return opts.repeat > 0;
+}
+
+// Compute one constant and return its CSV row (on rank 0)
+std::string runOnce(const ConstantSpec &spec, long N, int rep,
+                    MPI::Intracomm &comm) {
+  mpf_set_default_prec(constantPrecision(spec, N));
+
+  comm.Barrier();
+  auto start = MPI::Wtime();
+  auto value = computeConstant(spec, N, comm);
+  comm.Barrier();
+  auto compute = MPI::Wtime() - start;
+  if (comm.Get_rank() != 0)
+    return {};
+
+  start = MPI::Wtime();
+  mp_exp_t exp{};
+  auto digits = value.get_str(exp, 10, N + exp);
+  auto convert = MPI::Wtime() - start;
+
+  std::ostringstream row{};
+  row << specName(spec) << ',' << comm.Get_size() << ',' << N << ','
+      << termCount(spec, constantSeed(spec), N) << ',' << rep << ','
+      << compute << ',' << convert << ',' << N / compute;
+  return row.str();
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <string>
+#include <utility>
+
+#include <gmpxx.h>
+#include <mpi.h>
+
+#include "transfer.hh"
+
+// Parallel decimal output. Rank 0 turns the fraction into the integer of
+// its first N digits, and the integer is cut into the ranks' digit ranges
+// top-down: a rank holding the digits of ranks [lo, hi) divides by the
+// power of ten at the first digit of rank mid = (lo + hi) / 2, keeps the
+// quotient and hands the remainder to rank mid. After log2(commSize)
+// rounds of these divisions, each on numbers half the size of the round
+// before, every rank converts only its own digits and writes them to the
+// file at an offset known in advance.
+
+constexpr int TAG_DIGITS = 4;
+
+// Fraction digits [first, last) that rank gets, counted from the point
+inline std::pair<long, long> digitRange(long N, int commSize, int rank) {
+  return {N * rank / commSize, N * (rank + 1) / commSize};
+}
+
+// This rank's digits as an integer below 10^(last - first); frac is the
+// number formed by all N digits and only read on rank 0
+inline mpz_class scatterDigits(mpz_class frac, long N, MPI::Intracomm &comm) {
+  auto commSize = comm.Get_size();
+  auto rank = comm.Get_rank();
+
+  int lo = 0;
+  int hi = commSize;
+  while (hi - lo > 1) {
+    auto mid = (lo + hi) / 2;
+    if (rank == lo) {
+      // Digits from the first of rank mid to the last of rank hi - 1
+      auto lowDigits = digitRange(N, commSize, hi - 1).second -
+                       digitRange(N, commSize, mid).first;
+      mpz_class pow{};
+      mpz_ui_pow_ui(pow.get_mpz_t(), 10, lowDigits);
+      mpz_class low{};
+      mpz_tdiv_qr(frac.get_mpz_t(), low.get_mpz_t(), frac.get_mpz_t(),
+                  pow.get_mpz_t());
+      sendMpz(low, mid, TAG_DIGITS, comm);
+    } else if (rank == mid) {
+      frac = recvMpz(lo, TAG_DIGITS, comm);
+    }
+    if (rank < mid)
+      hi = mid;
+    else
+      lo = mid;
+  }
+  return frac;
+}
+
+// Write sum, known on rank 0, with N digits after the point and a newline
+// to path. Digits are those print shows: rounded to N + 1 places, the last
+// dropped, so values just below a round number come out round. Collective.
+inline bool writeDigits(const mpf_class &sum, long N, const char *path,
+                        MPI::Intracomm &comm) {
+  auto commSize = comm.Get_size();
+  auto rank = comm.Get_rank();
+
+  std::string head{};
+  mpz_class frac{};
+  if (rank == 0) {
+    mpz_class pow{};
+    mpz_ui_pow_ui(pow.get_mpz_t(), 10, N + 1);
+    mpf_class scaled = sum * mpf_class{pow, sum.get_prec()} + 0.5;
+    mpz_class all{scaled};
+    all /= 10;
+    pow /= 10;
+
+    mpz_class intPart{};
+    mpz_tdiv_qr(intPart.get_mpz_t(), frac.get_mpz_t(), all.get_mpz_t(),
+                pow.get_mpz_t());
+    head = intPart.get_str() + ".";
+  }
+  long headSize = head.size();
+  comm.Bcast(&headSize, 1, MPI::LONG, 0);
+
+  auto [first, last] = digitRange(N, commSize, rank);
+  auto width = last - first;
+  auto digits = scatterDigits(std::move(frac), N, comm).get_str();
+  if (width == 0)
+    digits.clear();
+  digits.insert(0, width - digits.size(), '0');
+
+  // The head goes before rank 0's digits, the newline after the last rank's
+  digits.insert(0, head);
+  if (rank == commSize - 1)
+    digits += '\n';
+  MPI_Offset offset = (rank == 0) ? 0 : headSize + first;
+
+  MPI_File fh;
+  auto err = MPI_File_open(comm, path, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                           MPI_INFO_NULL, &fh);
+  if (err != MPI_SUCCESS)
+    return false;
+
+  MPI_File_set_size(fh, 0);
+  err = MPI_File_write_at_all(fh, offset, digits.data(), digits.size(),
+                              MPI_CHAR, MPI_STATUS_IGNORE);
+  MPI_File_close(&fh);
+  return err == MPI_SUCCESS;
+}
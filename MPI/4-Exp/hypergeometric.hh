@@ -0,0 +1,82 @@
+#pragma once
+
+#include <utility>
+
+#include <gmpxx.h>
+#include <mpi.h>
+
+#include "transfer.hh"
+#include "tree_reduce.hh"
+
+// Binary splitting of a general hypergeometric series
+//
+//   S = sum_{k >= 0} a(k) * (p(0) * ... * p(k)) / (q(0) * ... * q(k))
+//
+// with integer-valued p, q and a. For a range [l, r) of terms
+//
+//   P(l, r) = p(l) * ... * p(r - 1),   Q(l, r) = q(l) * ... * q(r - 1),
+//   T(l, r) = Q(l, r) * sum_{k = l}^{r - 1} a(k) * p(l) ... p(k) /
+//                                               (q(l) ... q(k)),
+//
+// so that S = T(0, n) / Q(0, n) up to the terms left out, and adjacent
+// ranges [l, m) and [m, r) combine as
+//
+//   P = P(l, m) * P(m, r),   Q = Q(l, m) * Q(m, r),
+//   T = T(l, m) * Q(m, r) + P(l, m) * T(m, r).
+//
+// The e engine of binary_split.hh is the case p = 1, a = 1 with P dropped.
+// Series are plugged in as a function term(k, p, q, a) setting p(k), q(k)
+// and a(k).
+
+struct SeriesPQT {
+  mpz_class p = 1;
+  mpz_class q = 1;
+  mpz_class t = 0;
+};
+
+// x followed by y
+inline void combinePQT(SeriesPQT &x, const SeriesPQT &y) {
+  x.t *= y.q;
+  x.t += x.p * y.t;
+  x.p *= y.p;
+  x.q *= y.q;
+}
+
+// Triple of the terms [l, r); the empty range gives the identity
+template <typename Term> SeriesPQT splitSeries(long l, long r, Term term) {
+  if (r <= l)
+    return {};
+  if (r - l == 1) {
+    SeriesPQT res{};
+    mpz_class a{};
+    term(l, res.p, res.q, a);
+    res.t = a * res.p;
+    return res;
+  }
+
+  auto m = l + (r - l) / 2;
+  auto res = splitSeries(l, m, term);
+  combinePQT(res, splitSeries(m, r, term));
+  return res;
+}
+
+// Combine the ranks' triples, rank r holding the range right before rank
+// r + 1's, into the triple for the whole range on rank 0
+inline SeriesPQT reduceSeries(SeriesPQT local, MPI::Intracomm &comm) {
+  constexpr int TAG_P = 5;
+  constexpr int TAG_Q = 6;
+  constexpr int TAG_T = 7;
+  auto send = [&comm](const SeriesPQT &x, int dest) {
+    sendMpz(x.p, dest, TAG_P, comm);
+    sendMpz(x.q, dest, TAG_Q, comm);
+    sendMpz(x.t, dest, TAG_T, comm);
+  };
+  auto recv = [&comm](int source) {
+    SeriesPQT x{};
+    x.p = recvMpz(source, TAG_P, comm);
+    x.q = recvMpz(source, TAG_Q, comm);
+    x.t = recvMpz(source, TAG_T, comm);
+    return x;
+  };
+  return reduceToRoot(std::move(local), send, recv, combinePQT, comm);
+}
@@ -1,18 +1,57 @@
+#include <algorithm>
 #include <cmath>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <optional>
 #include <string_view>
+#include <utility>
+#include <vector>
 
 #include <gmpxx.h>
 #include <mpi.h>
 
+#include "binary_split.hh"
+#include "checkpoint.hh"
+#include "constants.hh"
+#include "digits.hh"
+#include "partition.hh"
+#include "transfer.hh"
+#include "tree_reduce.hh"
+
+// How the partial sums of the processes are formed:
+//   split - binary splitting per process, pairs combined in a tree
+//   chain - running factorials handed from each process to the next
+enum class Engine { Split, Chain };
+
+// How the terms are divided among the processes:
+//   balanced - ranges of equal estimated cost, see partition.hh
+//   equal    - ranges of equal numbers of terms
+enum class Partition { Balanced, Equal };
+
+struct Options {
+  ConstantSpec constant{};
+  Engine engine = Engine::Split;
+  Partition partition = Partition::Balanced;
+  const char *out = nullptr;        // digits written in parallel if given
+  const char *checkpoint = nullptr; // directory of checkpoints if given
+  double period = 60;               // seconds between checkpoints
+  bool resume = false;              // continue from the checkpoints
+};
+
+// Blocks per process the split engine works in when checkpointing
+constexpr long CHECKPOINT_BLOCKS = 16;
+
+bool parseOptions(int ac, char **av, Options &opts);
+void output(const Options &opts, int N, std::string_view sv, mpf_class &sum);
+mpf_class splitSum(int start, int end, Checkpointer *ckpt);
+SeriesPQ splitCheckpointed(long a, long b, Checkpointer &ckpt);
+mpf_class chainSum(int start, int end, Checkpointer *ckpt);
 int calculateMaxN(int N);
 mpz_class getPrevFact(int rank);
-void sendLocSum(mpf_class &locSumFloat);
 void mpz_set_ull(mpz_class &num, int_fast64_t ull);
-void collect(int commSize, mpf_class &locSumFloat);
+void collect(mpf_class &locSumFloat);
 void print(int N, std::string_view sv, mpf_class &locSumFloat);
 std::pair<int, int> getInterval(int termNum, int commSize, int rank);
 
@@ -22,9 +61,17 @@ int main(int ac, char **av) {
   auto commSize = MPI::COMM_WORLD.Get_size();
   auto rank = MPI::COMM_WORLD.Get_rank();
 
-  if (ac < 2) {
+  Options opts{};
+  if (ac < 2 || !parseOptions(ac, av, opts)) {
     if (rank == 0)
-      std::cout << "Usage: " << av[0] << " [N]" << std::endl;
+      std::cout << "Usage: " << av[0]
+                << " [N] [--const e|pi|ln2|exp:u/v|sqrt:n]"
+                   " [--engine split|chain] [--partition balanced|equal]"
+                   " [--out file]"
+                   " [--checkpoint dir [--period seconds] [--resume]]\n"
+                   "Constants other than e take the split engine and no"
+                   " checkpoints"
+                << std::endl;
 
     MPI::Finalize();
     return 0;
@@ -32,6 +79,16 @@ int main(int ac, char **av) {
 
   const auto N = std::atoi(av[1]);
 
+  // Constants other than e go through the general series engine
+  if (opts.constant.kind != Constant::E) {
+    mpf_set_default_prec(constantPrecision(opts.constant, N));
+    auto sum = computeConstant(opts.constant, N, MPI::COMM_WORLD);
+    output(opts, N, av[1], sum);
+
+    MPI::Finalize();
+    return 0;
+  }
+
   // Calc the number of terms we must calculate
   int termNum{};
   if (rank == 0)
@@ -40,7 +97,117 @@ int main(int ac, char **av) {
   MPI::COMM_WORLD.Bcast(&termNum, 1, MPI::INT, 0);
 
   // Calc starts and ends of summing among processes
-  auto [start, end] = getInterval(termNum, commSize, rank);
+  auto [start, end] = (opts.partition == Partition::Balanced)
+                          ? balancedInterval(termNum, commSize, rank)
+                          : getInterval(termNum, commSize, rank);
+
+  // Precision chosen to be 64 + [ln(10)/ln(2) * N] bits
+  mpf_set_default_prec(64 + std::ceil(3.33 * N));
+
+  std::optional<Checkpointer> ckpt{};
+  if (opts.checkpoint)
+    ckpt.emplace(opts.checkpoint, static_cast<int>(opts.engine), N,
+                 opts.period, opts.resume, MPI::COMM_WORLD);
+  auto *ckptPtr = ckpt ? &*ckpt : nullptr;
+
+  auto sum = (opts.engine == Engine::Split) ? splitSum(start, end, ckptPtr)
+                                            : chainSum(start, end, ckptPtr);
+  if (opts.resume) {
+    int resumed = ckpt->resumed();
+    int total{};
+    MPI::COMM_WORLD.Reduce(&resumed, &total, 1, MPI::INT, MPI::SUM, 0);
+    if (rank == 0)
+      std::cerr << "Resumed " << total << " of " << commSize
+                << " processes from checkpoints" << std::endl;
+  }
+  output(opts, N, av[1], sum);
+
+  MPI::Finalize();
+  return 0;
+}
+
+void output(const Options &opts, int N, std::string_view sv, mpf_class &sum) {
+  auto rank = MPI::COMM_WORLD.Get_rank();
+  if (opts.out) {
+    if (!writeDigits(sum, N, opts.out, MPI::COMM_WORLD) && rank == 0)
+      std::cerr << "Cannot write " << opts.out << std::endl;
+  } else if (rank == 0) {
+    print(N, sv, sum);
+  }
+}
+
+bool parseOptions(int ac, char **av, Options &opts) {
+  for (int i = 2; i < ac; ++i) {
+    std::string_view arg = av[i];
+    if (arg == "--resume") {
+      opts.resume = true;
+      continue;
+    }
+    if (i + 1 == ac)
+      return false;
+    std::string_view val = av[++i];
+    if (arg == "--const" && parseConstant(val, opts.constant))
+      continue;
+    else if (arg == "--engine" && val == "split")
+      opts.engine = Engine::Split;
+    else if (arg == "--engine" && val == "chain")
+      opts.engine = Engine::Chain;
+    else if (arg == "--partition" && val == "balanced")
+      opts.partition = Partition::Balanced;
+    else if (arg == "--partition" && val == "equal")
+      opts.partition = Partition::Equal;
+    else if (arg == "--out")
+      opts.out = av[i];
+    else if (arg == "--checkpoint")
+      opts.checkpoint = av[i];
+    else if (arg == "--period")
+      opts.period = std::atof(av[i]);
+    else
+      return false;
+  }
+  if (opts.constant.kind != Constant::E &&
+      (opts.engine != Engine::Split || opts.checkpoint))
+    return false;
+  return !opts.resume || opts.checkpoint;
+}
+
+mpf_class splitSum(int start, int end, Checkpointer *ckpt) {
+  // Terms 1/start! ... 1/(end - 1)! of this process are the range
+  // [start - 1, end - 1) of the splitting
+  auto local = ckpt ? splitCheckpointed(start - 1, end - 1, *ckpt)
+                    : splitRange(start - 1, end - 1);
+  auto total = reduceTree(std::move(local), MPI::COMM_WORLD);
+  if (MPI::COMM_WORLD.Get_rank() != 0)
+    return {};
+
+  mpf_class sum = total.p;
+  sum /= mpf_class{total.q};
+  sum += 1;
+  return sum;
+}
+
+SeriesPQ splitCheckpointed(long a, long b, Checkpointer &ckpt) {
+  // The range goes in blocks, each split on its own and appended to the
+  // pair of the blocks before, which is what a checkpoint holds
+  CheckpointState state{a, 0, 1};
+  if (!ckpt.load(a, b, state))
+    state = {a, 0, 1};
+
+  SeriesPQ done{state.x, state.y};
+  auto block = std::max(SPLIT_LEAF, (b - a) / CHECKPOINT_BLOCKS);
+  for (auto next = state.next; next < b;) {
+    auto stop = std::min(b, next + block);
+    combine(done, splitRange(next, stop));
+    next = stop;
+    if (next == b || ckpt.due())
+      ckpt.save(a, b, {next, done.p, done.q});
+  }
+  return done;
+}
+
+mpf_class chainSum(int start, int end, Checkpointer *ckpt) {
+  auto commSize = MPI::COMM_WORLD.Get_size();
+  auto rank = MPI::COMM_WORLD.Get_rank();
 
   mpz_class a = end - 1;
   mpz_class s = end;
@@ -48,56 +215,72 @@ int main(int ac, char **av) {
   mpz_class locCurrFact = 1_mpz;
   mpz_class locSum = 0_mpz;
 
-  for (auto i = end - 2; i > start; i--) {
-    if (i % (1u << 13) == 0) {
-      locSum += locCurrFact * s;
-      locCurrFact *= a;
+  // A checkpoint is taken at a flush, where s = a = i, or at the end
+  CheckpointState state{};
+  auto from = end - 2;
+  auto localDone = false;
+  if (ckpt && ckpt->load(start, end, state)) {
+    locSum = state.x;
+    locCurrFact = state.y;
+    localDone = (state.next == start);
+    mpz_set_ull(a, state.next);
+    s = a;
+    from = state.next - 1;
+  }
 
-      mpz_set_ull(a, i);
-      s = a;
-    } else {
-      a *= i;
-      s += a;
+  if (!localDone) {
+    for (auto i = from; i > start; i--) {
+      if (i % (1u << 13) == 0) {
+        locSum += locCurrFact * s;
+        locCurrFact *= a;
+
+        mpz_set_ull(a, i);
+        s = a;
+        if (ckpt && ckpt->due())
+          ckpt->save(start, end, {i, locSum, locCurrFact});
+      } else {
+        a *= i;
+        s += a;
+      }
     }
-  }
 
-  locSum += locCurrFact * s;
-  locCurrFact *= a;
+    locSum += locCurrFact * s;
+    locCurrFact *= a;
 
-  // locCurrFact = start * (start + 1) * ... * (end - 2) * (end - 1)
-  locCurrFact *= start;
+    // locCurrFact = start * (start + 1) * ... * (end - 2) * (end - 1)
+    locCurrFact *= start;
+    if (ckpt)
+      ckpt->save(start, end, {start, locSum, locCurrFact});
+  }
 
   if (rank != 0)
     locCurrFact *= getPrevFact(rank);
 
   // Send next process largest factorial of THIS process
   // Still valid if we have only 1 process
+  // The buffer must outlive the send, which completes before returning
+  std::vector<char> factSendBuf{};
+  MPI::Request factSend{};
   if (rank < commSize - 1) {
-    auto factStrSend = locCurrFact.get_str(32);
-    MPI::COMM_WORLD.Isend(factStrSend.data(), factStrSend.size() + 1, MPI::CHAR,
-                          rank + 1, 0);
+    factSendBuf = packMpz(locCurrFact);
+    factSend = MPI::COMM_WORLD.Isend(factSendBuf.data(), factSendBuf.size(),
+                                     MPI::BYTE, rank + 1, 0);
   }
 
   // By now all processes have value of their maximum factorial stored in
   // LocCurrFact Convert all integer sums to floating point ones and perform
-  // division by largest factorial to get true sum of THIS process Precision
-  // chosen to be 64 + [ln(10)/ln(2) * N] bits
-  mpf_set_default_prec(64 + std::ceil(3.33 * N));
+  // division by largest factorial to get true sum of THIS process
 
   mpf_class rankMaxFactFloat = locCurrFact;
   mpf_class locSumFloat = locSum / rankMaxFactFloat;
 
-  if (rank != 0) {
-    sendLocSum(locSumFloat);
-  } else {
-    collect(commSize, locSumFloat);
-    print(N, av[1], locSumFloat);
-  }
+  collect(locSumFloat);
 
-  MPI::Finalize();
-  return 0;
+  factSend.Wait();
+  return locSumFloat;
 }
 
+
 int calculateMaxN(int N) {
   auto x_curr = 3.0;
   auto x_prev = x_curr;
@@ -142,60 +325,25 @@ void print(int N, std::string_view sv, mpf_class &locSumFloat) {
 
 mpz_class getPrevFact(int rank) {
   // All processes except first receive largest factorial from prev process
-  MPI::Status status{};
-
-  // Get length of passed number
-  MPI::COMM_WORLD.Probe(rank - 1, 0, status);
-  auto recvLength = status.Get_count(MPI::CHAR);
-
-  std::string factStrRecv{};
-  factStrRecv.resize(recvLength);
-
-  MPI::COMM_WORLD.Recv(factStrRecv.data(), recvLength, MPI::CHAR, rank - 1, 0);
-
-  mpz_class rankFactFromStr{factStrRecv.data(), 32};
 
   // If cur process is not last, multiply largest factorial of prev
   // proc by [start * (start + 1) * ... * (end - 2) * (end - 1)] of this
   // proc to obtain largest factorial of this proc
-  return rankFactFromStr;
+  return recvMpz(rank - 1, 0, MPI::COMM_WORLD);
 }
 
-void sendLocSum(mpf_class &locSumFloat) {
-  auto *tmp = locSumFloat.get_mpf_t();
-  MPI::COMM_WORLD.Send(&tmp->_mp_prec, 1, MPI::INT, 0, 0);
-  MPI::COMM_WORLD.Send(&tmp->_mp_size, 1, MPI::INT, 0, 0);
-  MPI::COMM_WORLD.Send(&tmp->_mp_exp, 1, MPI::LONG, 0, 0);
-
-  int tmpLimbsSize = sizeof(tmp->_mp_d[0]) * tmp->_mp_size;
-
-  MPI::COMM_WORLD.Send(&tmpLimbsSize, 1, MPI::INT, 0, 0);
-  MPI::COMM_WORLD.Send(reinterpret_cast<char *>(tmp->_mp_d), tmpLimbsSize,
-                       MPI::CHAR, 0, 0);
-}
-
-void collect(int commSize, mpf_class &locSumFloat) {
-  locSumFloat += 1;
-
-  mpf_class sum_i{};
-  for (int i = 1; i < commSize; i++) {
-    auto *tmp = sum_i.get_mpf_t();
-    MPI::COMM_WORLD.Recv(&tmp->_mp_prec, 1, MPI::INT, i, 0);
-    MPI::COMM_WORLD.Recv(&tmp->_mp_size, 1, MPI::INT, i, 0);
-    MPI::COMM_WORLD.Recv(&tmp->_mp_exp, 1, MPI::LONG, i, 0);
-
-    int tmpSize{};
-    MPI::COMM_WORLD.Recv(&tmpSize, 1, MPI::INT, i, 0);
-
-    auto *tmpLimbs =
-        reinterpret_cast<mp_limb_t *>(calloc(tmpSize, sizeof(char)));
-
-    MPI::COMM_WORLD.Recv(reinterpret_cast<char *>(tmpLimbs), tmpSize, MPI::CHAR,
-                         i, 0);
-
-    free(tmp->_mp_d);
-    tmp->_mp_d = tmpLimbs;
-
-    locSumFloat += sum_i;
-  }
+void collect(mpf_class &locSumFloat) {
+  // Partial sums meet at the first process in a tree, one packed
+  // message per transfer
+  constexpr int TAG_SUM = 3;
+  auto &comm = MPI::COMM_WORLD;
+  auto send = [&comm](const mpf_class &sum, int dest) {
+    sendMpf(sum, dest, TAG_SUM, comm);
+  };
+  auto recv = [&comm](int source) { return recvMpf(source, TAG_SUM, comm); };
+  auto add = [](mpf_class &sum, const mpf_class &other) { sum += other; };
+
+  locSumFloat = reduceToRoot(std::move(locSumFloat), send, recv, add, comm);
+  if (comm.Get_rank() == 0)
+    locSumFloat += 1;
 }
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cmath>
+#include <utility>
+
+// Term ranges of equal cost. Both engines spend their time multiplying
+// numbers that grow to the size of the product of their terms, i.e. the
+// cost of a range of terms is an increasing function of that product's
+// bit size alone: about B log B for binary splitting and about B^2 for
+// the running product of the chain, B bits. Ranges of equal B therefore
+// cost the same for either engine, and B of [1, k) is log2((k - 1)!),
+// which lgamma gives without touching the numbers. Later terms are
+// larger, so later processes get fewer of them.
+
+// Bits of (k - 1)!, the product of terms [1, k)
+inline double productBits(long k) { return std::lgamma(k) / std::log(2.0); }
+
+// First term of process rank when [lo, hi) is divided so that every
+// process's share of bits(k), the bits of the product of terms [lo, k),
+// is the same
+template <typename Bits>
+long balancedBoundary(long lo, long hi, int commSize, int rank, Bits bits) {
+  if (rank == commSize)
+    return hi;
+  auto base = bits(lo);
+  auto target = (bits(hi) - base) * rank / commSize;
+  while (lo < hi) {
+    auto mid = lo + (hi - lo) / 2;
+    if (bits(mid) - base < target)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+// Terms [start, end) of process rank, covering [1, termNum] over all
+// processes like getInterval
+inline std::pair<int, int> balancedInterval(int termNum, int commSize,
+                                            int rank) {
+  return {balancedBoundary(1, termNum + 1, commSize, rank, productBits),
+          balancedBoundary(1, termNum + 1, commSize, rank + 1, productBits)};
+}
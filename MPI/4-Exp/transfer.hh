@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <gmpxx.h>
+#include <mpi.h>
+
+// Point-to-point transfer of big numbers between ranks. A number is packed
+// into one buffer holding a small header followed by its limbs as they lie
+// in memory, so packing and unpacking are copies and a number of n bits
+// takes about n / 8 bytes on the wire. The receiver learns the length of
+// the buffer by probing, so one message per number. Limbs go as raw bytes:
+// all ranks must share the limb size and byte order.
+
+struct MpzHeader {
+  long size; // signed count of limbs
+};
+
+struct MpfHeader {
+  int prec; // in limbs
+  int size; // signed count of limbs
+  long exp; // in limbs
+};
+
+inline std::vector<char> packLimbs(const void *header, std::size_t headerBytes,
+                                   const mp_limb_t *limbs, long count) {
+  auto limbBytes = count * sizeof(mp_limb_t);
+  std::vector<char> buf(headerBytes + limbBytes);
+  std::memcpy(buf.data(), header, headerBytes);
+  if (limbBytes != 0)
+    std::memcpy(buf.data() + headerBytes, limbs, limbBytes);
+  return buf;
+}
+
+inline std::vector<char> packMpz(const mpz_class &num) {
+  auto *z = num.get_mpz_t();
+  MpzHeader header{z->_mp_size};
+  return packLimbs(&header, sizeof(header), mpz_limbs_read(z),
+                   mpz_size(z));
+}
+
+inline mpz_class unpackMpz(const std::vector<char> &buf) {
+  MpzHeader header{};
+  std::memcpy(&header, buf.data(), sizeof(header));
+
+  mpz_class num{};
+  auto *z = num.get_mpz_t();
+  auto count = std::labs(header.size);
+  if (count != 0) {
+    std::memcpy(mpz_limbs_write(z, count), buf.data() + sizeof(header),
+                count * sizeof(mp_limb_t));
+    mpz_limbs_finish(z, header.size);
+  }
+  return num;
+}
+
+inline std::vector<char> packMpf(const mpf_class &num) {
+  auto *f = num.get_mpf_t();
+  MpfHeader header{f->_mp_prec, f->_mp_size, f->_mp_exp};
+  return packLimbs(&header, sizeof(header), f->_mp_d, std::abs(f->_mp_size));
+}
+
+inline mpf_class unpackMpf(const std::vector<char> &buf) {
+  MpfHeader header{};
+  std::memcpy(&header, buf.data(), sizeof(header));
+
+  // At least prec + 1 limbs get allocated, which any float of that
+  // precision fits in
+  mpf_class num{0, static_cast<mp_bitcnt_t>(header.prec) * GMP_NUMB_BITS};
+  auto *f = num.get_mpf_t();
+  std::memcpy(f->_mp_d, buf.data() + sizeof(header),
+              buf.size() - sizeof(header));
+  f->_mp_size = header.size;
+  f->_mp_exp = header.exp;
+  return num;
+}
+
+inline void sendPacked(const std::vector<char> &buf, int dest, int tag,
+                       MPI::Intracomm &comm) {
+  comm.Send(buf.data(), buf.size(), MPI::BYTE, dest, tag);
+}
+
+inline std::vector<char> recvPacked(int source, int tag,
+                                    MPI::Intracomm &comm) {
+  MPI::Status status{};
+  comm.Probe(source, tag, status);
+
+  std::vector<char> buf(status.Get_count(MPI::BYTE));
+  comm.Recv(buf.data(), buf.size(), MPI::BYTE, source, tag);
+  return buf;
+}
+
+inline void sendMpz(const mpz_class &num, int dest, int tag,
+                    MPI::Intracomm &comm) {
+  sendPacked(packMpz(num), dest, tag, comm);
+}
+
+inline mpz_class recvMpz(int source, int tag, MPI::Intracomm &comm) {
+  return unpackMpz(recvPacked(source, tag, comm));
+}
+
+inline void sendMpf(const mpf_class &num, int dest, int tag,
+                    MPI::Intracomm &comm) {
+  sendPacked(packMpf(num), dest, tag, comm);
+}
+
+inline mpf_class recvMpf(int source, int tag, MPI::Intracomm &comm) {
+  return unpackMpf(recvPacked(source, tag, comm));
+}
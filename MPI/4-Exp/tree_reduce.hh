@@ -0,0 +1,30 @@
+#pragma once
+
+#include <utility>
+
+#include <mpi.h>
+
+// Reduce one value per rank to rank 0 in log2(commSize) rounds: in round s
+// every rank r divisible by 2^(s + 1) receives the value of rank r + 2^s
+// and combines it into its own as combine(own, received), so the values
+// are combined in rank order and combine need not be commutative. The
+// result is only meaningful on rank 0.
+//
+//   send(value, dest)  - send value to rank dest
+//   recv(source)       - receive and return the value sent by rank source
+template <typename T, typename Send, typename Recv, typename Combine>
+T reduceToRoot(T local, Send send, Recv recv, Combine combine,
+               MPI::Intracomm &comm) {
+  auto commSize = comm.Get_size();
+  auto rank = comm.Get_rank();
+
+  for (int stride = 1; stride < commSize; stride *= 2) {
+    if (rank % (2 * stride) != 0) {
+      send(local, rank - stride);
+      break;
+    }
+    if (rank + stride < commSize)
+      combine(local, recv(rank + stride));
+  }
+  return local;
+}
@@ -1,18 +1,16 @@
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <iomanip>
+#include <limits>
+#include <string_view>
 
 #include <mpi.h>
 
-/* Function to sum reciprocals */
-double calcSum(int64_t start, int64_t end) {
-  double partSum = 0.0;
+#include "harmonic_engine.hh"
+#include "master_worker.hh"
 
-  for (int64_t i = start; i < end; i++)
-    partSum += 1.0 / static_cast<double>(i);
-
-  return partSum;
-}
+void printSum(const HarmonicResult &total);
 
 int main(int ac, char **av) {
   MPI::Init(ac, av);
@@ -21,16 +19,34 @@ int main(int ac, char **av) {
   auto rank = MPI::COMM_WORLD.Get_rank();
 
   /* Handle wrong input */
-  if (ac < 2) {
+  HarmonicOptions opts{};
+  ScheduleOptions schedule{};
+  auto dynamic = false;
+  auto extra = [&](std::string_view arg, std::string_view val) {
+    if (arg == "--schedule" && (val == "static" || val == "dynamic"))
+      dynamic = (val == "dynamic");
+    else if (arg == "--chunk-time")
+      schedule.chunkTime = std::atof(val.data());
+    else if (arg == "--progress")
+      schedule.progress = std::atof(val.data());
+    else
+      return false;
+    return true;
+  };
+  if (!parseHarmonicOptions(ac, av, 1, opts, extra) ||
+      schedule.chunkTime <= 0) {
     if (!rank)
-      std::cout << "Usage: " << av[0] << " [N]" << std::endl;
+      std::cout << "Usage: " << av[0] << " " << HARMONIC_USAGE << "\n"
+                << "  [--schedule static|dynamic] [--chunk-time s]"
+                   " [--progress s]"
+                << std::endl;
 
     MPI::Finalize();
     return 0;
   }
 
   /* Split COMM_WORLD into two parts: one for proc #0 and second for the rest */
-  auto myComm = MPI::COMM_WORLD.Split(!!rank, rank);
+  auto myComm = splitRoot(MPI::COMM_WORLD, 0);
   if (MPI::Comm_Null() == myComm) {
     std::cout << "Proc " << rank << ": failed to split communicator"
               << std::endl;
@@ -51,39 +67,53 @@ int main(int ac, char **av) {
   std::cout << "  rank = " << myCommRank << std::endl;
   std::cout << "  commsize = " << myCommSize << std::endl << std::endl;
 
+  /* Dynamic schedule: proc #0 hands out chunks of terms to the rest and
+   * collects their sums */
+  if (dynamic) {
+    if (rank == 0)
+      printSum(harmonicFinish(
+          opts, harmonicMaster(1, harmonicHeadEnd(opts), schedule,
+                               MPI::COMM_WORLD)));
+    else
+      harmonicWorker(MPI::COMM_WORLD);
+    MPI::Finalize();
+    return 0;
+  }
+
   /* Calculate sum for proc from 1 to N inside myCommcommucator */
   if (rank == 0) {
     MPI::Finalize();
     return 0;
   }
 
-  const auto N = std::atoll(av[1]);
-  const auto diff = N / myCommSize;
-  auto start = 1 + diff * myCommRank;
-  auto end = 1 + diff * (myCommRank + 1);
-
-  if (N % myCommSize) {
-    if (myCommRank < N % myCommSize) {
-      start += myCommRank;
-      end += myCommRank + 1;
-    } else {
-      start += (N % myCommSize);
-      end += (N % myCommSize);
-    }
+  /* Calculate sum for each process, contiguous whole blocks of terms, and
+   * collect all into 0-th process, node by node */
+  HarmonicResult total{};
+  {
+    Topology topo{myComm};
+    int coords[2];
+    topo.cart().Get_coords(topo.cart().Get_rank(), 2, coords);
+    std::cout << "Proc " << rank << ": node rank = " << topo.node().Get_rank()
+              << " of " << topo.node().Get_size()
+              << ", nodes = " << topo.nodes() << ", cart = (" << coords[0]
+              << ", " << coords[1] << ")" << std::endl;
+
+    total = harmonicDistributed(opts, topo);
   }
 
-  /* Calculate sum for each process */
-  auto partSum = calcSum(start, end);
-
-  /* Collecting all into 0-th process */
-  double totalSum{};
-  myComm.Reduce(&partSum, &totalSum, 1, MPI::DOUBLE, MPI::SUM, 0);
-  if (myCommRank == 0) {
-    std::cout << "***************" << std::endl;
-    std::cout << "SUM = " << totalSum << std::endl;
-    std::cout << "***************" << std::endl;
-  }
+  if (myCommRank == 0)
+    printSum(total);
 
   MPI::Finalize();
   return 0;
 }
+
+void printSum(const HarmonicResult &total) {
+  std::cout << "***************" << std::endl;
+  std::cout << "SUM = "
+            << std::setprecision(std::numeric_limits<double>::max_digits10)
+            << total.sum << std::endl;
+  std::cout << "ERROR BOUND = " << std::setprecision(3) << total.bound
+            << std::endl;
+  std::cout << "***************" << std::endl;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include <mpi.h>
+
+#include "harmonic.hh"
+
+/* Dynamic schedule of the terms [first, end) of the harmonic series: the
+ * master (rank 0) hands out chunks of terms to the workers (all the other
+ * ranks) as they ask for them, every request carrying the result of the
+ * worker's previous chunk.
+ *
+ * A chunk is sized for the worker that gets it, to take about chunkTime
+ * seconds at the rate the worker showed on its previous chunk, but no more
+ * than the remaining terms over twice the number of workers, so that the
+ * last chunks shrink and the workers finish together. Chunks are cut at
+ * block boundaries and summed up in index order at the end, so the result
+ * is the same as with the static partition. */
+
+constexpr int TAG_RESULT = 1;
+constexpr int TAG_WORK = 2;
+
+/* First chunk of every worker, before its rate is known */
+constexpr std::int64_t FIRST_CHUNK = 16 * HARMONIC_BLOCK;
+
+struct ChunkResult {
+  Compensated sum{};
+  double seconds = 0;
+  std::int64_t first = 0; /* [first, last), empty for the first request */
+  std::int64_t last = 0;
+};
+
+struct ScheduleOptions {
+  double chunkTime = 0.05; /* target seconds per chunk */
+  double progress = 1;     /* seconds between reports, 0 for none */
+};
+
+/* Terms in the next chunk of a worker summing rate terms per second */
+inline std::int64_t chunkSize(double rate, std::int64_t remaining,
+                              int workers, double chunkTime) {
+  auto size = (rate > 0) ? static_cast<std::int64_t>(rate * chunkTime)
+                         : FIRST_CHUNK;
+  size = std::min(size, remaining / (2 * workers));
+  return std::max(size, HARMONIC_BLOCK);
+}
+
+/* Master side: sum of [first, end) on rank 0 of comm, whose other ranks
+ * run harmonicWorker */
+inline double harmonicMaster(std::int64_t first, std::int64_t end,
+                             const ScheduleOptions &opts,
+                             const MPI::Intracomm &comm) {
+  auto workers = comm.Get_size() - 1;
+  if (workers == 0)
+    return harmonicSum(first, end).value();
+
+  std::map<std::int64_t, Compensated> parts{};
+  std::vector<double> rate(comm.Get_size());
+  auto total = end - first;
+  std::int64_t done = 0;
+  auto start = MPI::Wtime();
+  auto nextReport = start + opts.progress;
+
+  for (auto active = workers; active > 0;) {
+    ChunkResult r{};
+    MPI::Status status{};
+    comm.Recv(&r, sizeof(r), MPI::BYTE, MPI::ANY_SOURCE, TAG_RESULT, status);
+    auto src = status.Get_source();
+    if (r.last > r.first) {
+      parts[r.first] = r.sum;
+      rate[src] = (r.last - r.first) / std::max(r.seconds, 1e-6);
+      done += r.last - r.first;
+    }
+
+    /* An empty chunk tells the worker to stop */
+    long long work[2] = {first, first};
+    if (first < end) {
+      auto size = chunkSize(rate[src], end - first, workers, opts.chunkTime);
+      auto blocks = std::max<std::int64_t>(size / HARMONIC_BLOCK, 1);
+      work[1] = std::min(end, (first / HARMONIC_BLOCK + blocks) *
+                                  HARMONIC_BLOCK);
+      first = work[1];
+    } else {
+      --active;
+    }
+    comm.Send(work, 2, MPI::LONG_LONG, src, TAG_WORK);
+
+    auto now = MPI::Wtime();
+    if (opts.progress > 0 && (now >= nextReport || active == 0)) {
+      std::cerr << "progress: " << std::fixed << std::setprecision(1)
+                << 100.0 * done / std::max<std::int64_t>(total, 1)
+                << "% of " << total << " terms, " << now - start << " s, "
+                << active << " workers busy" << std::defaultfloat
+                << std::endl;
+      nextReport = now + opts.progress;
+    }
+  }
+
+  Compensated sum{};
+  for (auto &[chunkFirst, part] : parts)
+    sum.add(part);
+  return sum.value();
+}
+
+/* Worker side: sum chunks until the master runs out of them */
+inline void harmonicWorker(const MPI::Intracomm &comm) {
+  ChunkResult r{};
+  for (;;) {
+    comm.Send(&r, sizeof(r), MPI::BYTE, 0, TAG_RESULT);
+    long long work[2];
+    comm.Recv(work, 2, MPI::LONG_LONG, 0, TAG_WORK);
+    if (work[0] == work[1])
+      return;
+
+    auto start = MPI::Wtime();
+    r.sum = harmonicSum(work[0], work[1]);
+    r.seconds = MPI::Wtime() - start;
+    r.first = work[0];
+    r.last = work[1];
+  }
+}
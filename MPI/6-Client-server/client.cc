@@ -1,20 +1,215 @@
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
 #include <mpi.h>
 
+#include "service.hh"
+
+// Client of the compute service. Every process of the client connects
+// together with the others and sends the jobs of its command line as one
+// batch per repetition, printing the responses as they come. Up to window
+// batches are in flight at a time: the next one goes out as soon as an
+// earlier one is fully answered, not only after the last one.
+//
+// Usage: mpirun -np C client [--port name] [--repeat N] [--window N]
+//                            [--quiet] [--shutdown] job...
+// jobs: harmonic:N[:tol] sort:n integral:a:b:n
+
+struct ClientOptions {
+  std::vector<Request> jobs{};
+  const char *port = nullptr; // looked up by SERVICE_NAME if not given
+  int repeat = 1;
+  int window = 4;             // batches in flight
+  bool quiet = false;         // print totals only
+  bool shutdown = false;      // ask the service to stop when done
+};
+
+bool parseOptions(int ac, char **av, ClientOptions &opts);
+void lookupPort(char *port_name);
+long long runBatches(MPI::Intercomm &server, const ClientOptions &opts,
+                     const std::vector<Request> &jobs, long long firstId);
+
 int main(int ac, char **av) {
   MPI::Init(ac, av);
+  auto rank = MPI::COMM_WORLD.Get_rank();
+
+  ClientOptions opts{};
+  if (!parseOptions(ac, av, opts)) {
+    if (rank == 0)
+      std::cerr << "Usage: " << av[0]
+                << " [--port name] [--repeat N] [--window N] [--quiet]"
+                   " [--shutdown] job...\n"
+                   "jobs: harmonic:N[:tol] sort:n integral:a:b:n"
+                << std::endl;
+    MPI::COMM_WORLD.Abort(1);
+  }
 
   // Look up for server's port name.
-  char port_name[MPI::MAX_PORT_NAME];
-  MPI::Lookup_name("name", MPI::INFO_NULL, port_name);
+  char port_name[MPI::MAX_PORT_NAME] = {};
+  if (rank == 0) {
+    if (opts.port)
+      std::copy_n(opts.port,
+                  std::min<std::size_t>(std::string_view{opts.port}.size(),
+                                        MPI::MAX_PORT_NAME - 1),
+                  port_name);
+    else
+      lookupPort(port_name);
+  }
+
+  // Connect to server, all processes together.
+  auto server = MPI::COMM_WORLD.Connect(port_name, MPI::INFO_NULL, 0);
+
+  // We may have come too late.
+  Response greeting{};
+  server.Recv(&greeting, sizeof(greeting), MPI::BYTE, 0, TAG_RESPONSE);
+  if (!greeting.ok) {
+    std::cerr << "client " << rank << ": refused, the service is shutting down"
+              << std::endl;
+    server.Disconnect();
+    MPI::Finalize();
+    return 0;
+  }
 
-  // Connect to server.
-  auto server = MPI::COMM_SELF.Connect(port_name, MPI::INFO_NULL, 0);
+  auto start = MPI::Wtime();
+  auto count = runBatches(server, opts, opts.jobs, 0);
+  auto time = MPI::Wtime() - start;
+  std::cout << "client " << rank << ": " << count << " jobs in " << time
+            << " s, " << count / time << " jobs/s" << std::endl;
 
-  // Send data to server.
-  int sendbuf = 42;
-  std::cout << "client: sendbuf equals to " << sendbuf << std::endl;
-  server.Send(&sendbuf, 1, MPI::INT, 0, 0);
+  MPI::COMM_WORLD.Barrier();
+  if (rank == 0 && opts.shutdown) {
+    Request stop{};
+    stop.kind = JobKind::Shutdown;
+    auto once = opts;
+    once.repeat = 1;
+    runBatches(server, once, {stop}, count);
+  }
+
+  // Say goodbye.
+  server.Send(nullptr, 0, MPI::BYTE, 0, TAG_BATCH);
+  server.Disconnect();
 
   MPI::Finalize();
   return 0;
 }
+
+bool parseOptions(int ac, char **av, ClientOptions &opts) {
+  for (int i = 1; i < ac; ++i) {
+    std::string_view arg = av[i];
+    Request req{};
+    if (arg == "--shutdown")
+      opts.shutdown = true;
+    else if (arg == "--port" && i + 1 < ac)
+      opts.port = av[++i];
+    else if (arg == "--repeat" && i + 1 < ac)
+      opts.repeat = atoi(av[++i]);
+    else if (arg == "--window" && i + 1 < ac)
+      opts.window = atoi(av[++i]);
+    else if (arg == "--quiet")
+      opts.quiet = true;
+    else if (parseRequest(arg, req) && req.kind != JobKind::Shutdown)
+      opts.jobs.push_back(req);
+    else
+      return false;
+  }
+  return opts.repeat > 0 && opts.window > 0 && !opts.jobs.empty() &&
+         static_cast<int>(opts.jobs.size()) <= MAX_BATCH;
+}
+
+// The server may still be starting: try for a while. Through the C API
+// with MPI_ERRORS_RETURN, since MPI may be built without C++ exceptions.
+void lookupPort(char *port_name) {
+  MPI_Errhandler handler{};
+  MPI_Comm_get_errhandler(MPI_COMM_WORLD, &handler);
+  MPI_Comm_set_errhandler(MPI_COMM_WORLD, MPI_ERRORS_RETURN);
+  int err = MPI_SUCCESS;
+  for (int attempt = 0;; ++attempt) {
+    err = MPI_Lookup_name(SERVICE_NAME, MPI_INFO_NULL, port_name);
+    if (err == MPI_SUCCESS || attempt == 50)
+      break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  MPI_Comm_set_errhandler(MPI_COMM_WORLD, handler);
+  MPI_Errhandler_free(&handler);
+  if (err != MPI_SUCCESS) {
+    std::cerr << "client: no service published as " << SERVICE_NAME
+              << std::endl;
+    MPI::COMM_WORLD.Abort(1);
+  }
+}
+
+// Send the jobs as opts.repeat batches, with ids from firstId on, keeping
+// up to opts.window of them in flight, and print the responses in the
+// order they come. Returns the number of jobs.
+long long runBatches(MPI::Intercomm &server, const ClientOptions &opts,
+                     const std::vector<Request> &jobs, long long firstId) {
+  auto rank = MPI::COMM_WORLD.Get_rank();
+  long long size = jobs.size();
+
+  std::map<long long, Request> pending{};
+  std::map<long long, std::vector<double>> inputs{};
+  std::vector<long long> left(opts.repeat, size); // responses per batch
+  int sent = 0;
+  int inFlight = 0;
+  auto send = [&] {
+    auto batch = jobs;
+    for (auto &req : batch) {
+      req.id = firstId + sent * size + (&req - batch.data());
+      pending[req.id] = req;
+      if (payloadSize(req) > 0) {
+        std::mt19937_64 gen(req.id * 1000 + rank);
+        std::uniform_real_distribution<double> dist{};
+        auto &data = inputs[req.id];
+        data.resize(req.n);
+        std::generate(data.begin(), data.end(), [&] { return dist(gen); });
+      }
+    }
+    server.Send(batch.data(), batch.size() * sizeof(Request), MPI::BYTE, 0,
+                TAG_BATCH);
+    for (auto &req : batch)
+      if (payloadSize(req) > 0)
+        server.Send(inputs[req.id].data(), req.n, MPI::DOUBLE, 0,
+                    TAG_PAYLOAD);
+    ++sent;
+    ++inFlight;
+  };
+
+  while (sent < opts.repeat || !pending.empty()) {
+    while (sent < opts.repeat && inFlight < opts.window)
+      send();
+
+    Response resp{};
+    server.Recv(&resp, sizeof(resp), MPI::BYTE, 0, TAG_RESPONSE);
+    std::vector<double> data(resp.n);
+    if (resp.n > 0)
+      server.Recv(data.data(), data.size(), MPI::DOUBLE, 0, TAG_PAYLOAD);
+
+    auto req = pending[resp.id];
+    if (req.kind == JobKind::Sort) {
+      auto &input = inputs[req.id];
+      std::sort(input.begin(), input.end());
+      resp.ok = resp.ok && data == input;
+      inputs.erase(req.id);
+    }
+    if (!opts.quiet || !resp.ok)
+      std::cout << "client " << rank << ": #" << resp.id << " "
+                << jobKindName(req.kind) << " "
+                << (resp.ok ? "ok" : "FAILED")
+                << " value = " << std::setprecision(17) << resp.value
+                << " error = " << std::setprecision(3) << resp.error
+                << " (worker " << resp.worker << ", " << resp.seconds
+                << " s)" << std::endl;
+    pending.erase(resp.id);
+    if (--left[(resp.id - firstId) / size] == 0)
+      --inFlight;
+  }
+  return opts.repeat * size;
+}
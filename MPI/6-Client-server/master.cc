@@ -1,10 +1,44 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
 #include <mpi.h>
 
+// Launch the compute service and one client job against it: the server
+// with a pool of workers first, then, once it has its port open, the
+// client, which runs the given jobs and shuts the service down.
+//
+// Usage: mpirun -np 1 master workers clients job...
+
 int main(int ac, char **av) {
   MPI::Init(ac, av);
 
-  MPI::COMM_SELF.Spawn("6_server", MPI::ARGV_NULL, 1, MPI::INFO_NULL, 0);
-  MPI::COMM_SELF.Spawn("6_client", MPI::ARGV_NULL, 1, MPI::INFO_NULL, 0);
+  if (ac < 4) {
+    std::cerr << "USAGE: " << av[0] << " workers clients job..." << std::endl;
+    MPI::Finalize();
+    return 0;
+  }
+  auto workers = std::atoi(av[1]);
+  auto clients = std::atoi(av[2]);
+
+  // The other programs sit next to this one.
+  std::string dir{av[0]};
+  dir = dir.substr(0, dir.find_last_of('/') + 1);
+  auto serverPath = dir + "mpi_06_server";
+  auto clientPath = dir + "mpi_06_client";
+
+  auto server = MPI::COMM_SELF.Spawn(serverPath.c_str(), MPI::ARGV_NULL,
+                                     workers + 1, MPI::INFO_NULL, 0);
+  char port_name[MPI::MAX_PORT_NAME];
+  server.Recv(port_name, MPI::MAX_PORT_NAME, MPI::CHAR, 0, 0);
+
+  std::vector<const char *> args{"--port", port_name, "--shutdown"};
+  for (int i = 3; i < ac; ++i)
+    args.push_back(av[i]);
+  args.push_back(nullptr);
+  MPI::COMM_SELF.Spawn(clientPath.c_str(), args.data(), clients,
+                       MPI::INFO_NULL, 0);
 
   MPI::Finalize();
   return 0;
@@ -1,24 +1,463 @@
+#include <deque>
 #include <iostream>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 #include <mpi.h>
 
+#include "service.hh"
+
+// Long-running compute service. Rank 0 serves any number of clients at
+// once; the other ranks are the worker pool that runs the jobs.
+//
+// Rank 0 never blocks on a client. A thread of its own accepts the
+// connections; the main thread keeps a receive posted for the next batch
+// of every process of every client, one for the input of every sort still
+// on its way, and those of every busy worker's job and result, and handles
+// whichever of them completes first (Waitsome). Clients can therefore keep
+// sending batches without waiting for the responses, and a slow client
+// holds up nobody but itself. Jobs go to whichever worker is idle, and
+// every response is sent back to its client as soon as the job is done.
+// Once a client has asked for a shutdown, clients that connect are turned
+// away, and the service stops as soon as the others are served.
+//
+// Usage: mpirun -np W+1 server
+// The port name is published as SERVICE_NAME and also printed. Clients of
+// a different mpirun find it through a name server (ompi-server) or take
+// it on their command line.
+
+struct Connection {
+  MPI::Intercomm comm{};
+  int open = 0;              // client processes that have not said goodbye
+  long long outstanding = 0; // greetings and responses not sent yet
+  std::vector<std::vector<Request>> batches{}; // buffer per client process
+};
+
+struct Job {
+  Request req{};
+  std::vector<double> data{};
+  Connection *conn = nullptr;
+  int source = 0; // rank in the client's group
+  Response resp{};
+  int worker = 0;        // rank running the job
+  int pending = 0;       // transfers with the worker not completed yet
+  bool fetching = false; // the worker's sorted array is on the way
+};
+
+// Response on its way to a client: its buffers must outlive the sends
+struct PendingSend {
+  Response resp{};
+  std::vector<double> data{};
+  Connection *conn = nullptr;
+  int left = 0; // sends not completed yet
+};
+
+// What a posted request is for
+enum class Event { Wake, Batch, Payload, Transfer, Sent };
+
+struct Posted {
+  Event event;
+  Connection *conn = nullptr;
+  int source = 0;
+  long long key = 0; // job id or send id
+};
+
+class Server {
+public:
+  // self: path of this program, to knock on the port with on shutdown
+  Server(const MPI::Intracomm &comm, const char *port, const char *self)
+      : comm_(comm), port_(port), self_(self),
+        acceptComm_(MPI::COMM_SELF.Dup()), wake_(MPI::COMM_SELF.Dup()) {
+    for (int w = 1; w < comm.Get_size(); ++w)
+      idle_.push_back(w);
+    post(wake_.Irecv(&wakeBuf_, 1, MPI::INT, 0, 0), {Event::Wake});
+    acceptor_ = std::thread{[this] { acceptLoop(); }};
+  }
+
+  // Serve clients until one of them has asked for a shutdown and all
+  // clients are gone
+  void run() {
+    std::vector<int> indices{};
+    std::vector<MPI::Status> statuses{};
+    while (!shutdown_ || !conns_.empty() || !jobs_.empty()) {
+      indices.resize(reqs_.size());
+      statuses.resize(reqs_.size());
+      auto count = MPI::Request::Waitsome(reqs_.size(), reqs_.data(),
+                                          indices.data(), statuses.data());
+      for (int i = 0; i < count; ++i) {
+        auto what = posted_[indices[i]]; // handlers may append to posted_
+        handle(what, statuses[i]);
+      }
+      dispatch();
+
+      // Forget the completed requests; new ones were appended
+      std::size_t kept = 0;
+      for (std::size_t i = 0; i < reqs_.size(); ++i)
+        if (reqs_[i] != MPI::REQUEST_NULL) {
+          reqs_[kept] = reqs_[i];
+          posted_[kept++] = posted_[i];
+        }
+      reqs_.resize(kept);
+      posted_.resize(kept);
+    }
+    stop();
+  }
+
+private:
+  // Acceptor thread: queue every new connection and wake the main thread,
+  // until the knocker of stop() connects
+  void acceptLoop() {
+    for (;;) {
+      auto client = acceptComm_.Accept(port_, MPI::INFO_NULL, 0);
+      std::lock_guard lock{mutex_};
+      if (stopping_) {
+        auto group = client.Get_remote_group();
+        auto knocked = MPI::Group::Compare(group, knocker_) == MPI::IDENT;
+        group.Free();
+        if (knocked) {
+          client.Disconnect();
+          return;
+        }
+      }
+      accepted_.push_back(client);
+      if (!stopping_) {
+        int one = 1;
+        wake_.Send(&one, 1, MPI::INT, 0, 0);
+      }
+    }
+  }
+
+  // Stop the acceptor by connecting to it, turn away the clients that came
+  // too late and release the workers. The connection has to come from
+  // another process, a copy of this program started with --knock, which
+  // waits for our word so that the acceptor can tell it from a client.
+  void stop() {
+    for (auto &r : reqs_)
+      if (r != MPI::REQUEST_NULL) {
+        r.Cancel();
+        r.Wait();
+      }
+    const char *args[] = {"--knock", port_, nullptr};
+    auto knocker = MPI::COMM_SELF.Spawn(self_, args, 1, MPI::INFO_NULL, 0);
+    {
+      std::lock_guard lock{mutex_};
+      knocker_ = knocker.Get_remote_group();
+      stopping_ = true;
+    }
+    knocker.Send(nullptr, 0, MPI::BYTE, 0, 0);
+    acceptor_.join();
+    acceptComm_.Free();
+    knocker_.Free();
+    knocker.Disconnect();
+    for (auto &client : accepted_)
+      refuse(client);
+    wake_.Free();
+
+    Request stop{};
+    stop.kind = JobKind::Shutdown;
+    for (int w = 1; w < comm_.Get_size(); ++w)
+      comm_.Send(&stop, sizeof(stop), MPI::BYTE, w, TAG_JOB);
+  }
+
+  void post(MPI::Request req, Posted what) {
+    reqs_.push_back(req);
+    posted_.push_back(what);
+  }
+
+  void postBatch(Connection &conn, int source) {
+    auto &buf = conn.batches[source];
+    post(conn.comm.Irecv(buf.data(), buf.size() * sizeof(Request),
+                         MPI::BYTE, source, TAG_BATCH),
+         {Event::Batch, &conn, source});
+  }
+
+  void handle(const Posted &what, const MPI::Status &status) {
+    switch (what.event) {
+    case Event::Wake:
+      onWake();
+      break;
+    case Event::Batch:
+      onBatch(*what.conn, what.source,
+              status.Get_count(MPI::BYTE) / sizeof(Request));
+      break;
+    case Event::Payload:
+      ready_.push_back(what.key);
+      break;
+    case Event::Transfer:
+      onTransfer(what.key);
+      break;
+    case Event::Sent:
+      onSent(what.key);
+      break;
+    }
+  }
+
+  void onWake() {
+    post(wake_.Irecv(&wakeBuf_, 1, MPI::INT, 0, 0), {Event::Wake});
+    std::vector<MPI::Intercomm> fresh{};
+    {
+      std::lock_guard lock{mutex_};
+      fresh.swap(accepted_);
+    }
+    for (auto &client : fresh) {
+      if (shutdown_) {
+        refuse(client);
+        continue;
+      }
+      auto &conn = conns_.emplace_back();
+      conn.comm = client;
+      conn.open = client.Get_remote_size();
+      conn.batches.assign(conn.open, std::vector<Request>(MAX_BATCH));
+      for (int source = 0; source < conn.open; ++source) {
+        greet(conn, source);
+        postBatch(conn, source);
+      }
+      std::cout << "server: client of " << conn.open
+                << " processes connected" << std::endl;
+    }
+  }
+
+  // Tell a process of a new client that its jobs are welcome
+  void greet(Connection &conn, int source) {
+    auto sendId = nextSend_++;
+    auto &send = sends_[sendId];
+    send.resp.id = GREETING_ID;
+    send.resp.ok = 1;
+    send.conn = &conn;
+    send.left = 1;
+    ++conn.outstanding;
+    post(conn.comm.Isend(&send.resp, sizeof(send.resp), MPI::BYTE, source,
+                         TAG_RESPONSE),
+         {Event::Sent, &conn, source, sendId});
+  }
+
+  // Turn away a client that came during the shutdown. Its processes leave
+  // as soon as they have the greeting, so the Disconnect is short.
+  void refuse(MPI::Intercomm &client) {
+    Response greeting{};
+    greeting.id = GREETING_ID;
+    for (int r = 0; r < client.Get_remote_size(); ++r)
+      client.Send(&greeting, sizeof(greeting), MPI::BYTE, r, TAG_RESPONSE);
+    client.Disconnect();
+    std::cout << "server: client refused, shutting down" << std::endl;
+  }
+
+  // Queue the jobs of a batch, or note a goodbye if it is empty
+  void onBatch(Connection &conn, int source, int count) {
+    if (count == 0) {
+      --conn.open;
+      closeIfDone(conn);
+      return;
+    }
+
+    conn.outstanding += count;
+    for (int i = 0; i < count; ++i) {
+      auto id = nextJob_++;
+      auto &job = jobs_[id];
+      job.req = conn.batches[source][i];
+      job.conn = &conn;
+      job.source = source;
+      job.data.resize(payloadSize(job.req));
+      if (job.data.empty())
+        ready_.push_back(id);
+      else
+        post(conn.comm.Irecv(job.data.data(), job.data.size(), MPI::DOUBLE,
+                             source, TAG_PAYLOAD),
+             {Event::Payload, &conn, source, id});
+    }
+    postBatch(conn, source);
+  }
+
+  // Hand ready jobs to idle workers, or run them here if there are none
+  void dispatch() {
+    while (!ready_.empty() && (!idle_.empty() || comm_.Get_size() == 1)) {
+      auto id = ready_.front();
+      ready_.pop_front();
+      auto &job = jobs_[id];
+      if (job.req.kind == JobKind::Shutdown) {
+        shutdown_ = true;
+        job.resp.id = job.req.id;
+        job.resp.ok = 1;
+        respond(id);
+      } else if (comm_.Get_size() == 1) {
+        job.resp = runJob(job.req, job.data);
+        respond(id);
+      } else {
+        job.worker = idle_.back();
+        idle_.pop_back();
+        transfer(id, comm_.Isend(&job.req, sizeof(job.req), MPI::BYTE,
+                                 job.worker, TAG_JOB));
+        if (!job.data.empty())
+          transfer(id, comm_.Isend(job.data.data(), job.data.size(),
+                                   MPI::DOUBLE, job.worker, TAG_PAYLOAD));
+        transfer(id, comm_.Irecv(&job.resp, sizeof(job.resp), MPI::BYTE,
+                                 job.worker, TAG_RESPONSE));
+      }
+    }
+  }
+
+  void transfer(long long id, MPI::Request req) {
+    post(req, {Event::Transfer, nullptr, 0, id});
+    ++jobs_[id].pending;
+  }
+
+  // Once the job and its input are sent and the worker has answered, fetch
+  // the sorted array, if any, into the now free input buffer; once that is
+  // in too, free the worker and answer
+  void onTransfer(long long id) {
+    auto &job = jobs_[id];
+    if (--job.pending > 0)
+      return;
+    if (job.resp.n > 0 && !job.fetching) {
+      job.fetching = true;
+      job.data.resize(job.resp.n);
+      transfer(id, comm_.Irecv(job.data.data(), job.data.size(), MPI::DOUBLE,
+                               job.worker, TAG_PAYLOAD));
+      return;
+    }
+    idle_.push_back(job.worker);
+    job.resp.worker = job.worker;
+    respond(id);
+  }
+
+  void respond(long long id) {
+    auto &job = jobs_[id];
+    auto sendId = nextSend_++;
+    auto &send = sends_[sendId];
+    send.resp = job.resp;
+    send.data = std::move(job.data);
+    send.conn = job.conn;
+    auto &client = job.conn->comm;
+    post(client.Isend(&send.resp, sizeof(send.resp), MPI::BYTE, job.source,
+                      TAG_RESPONSE),
+         {Event::Sent, job.conn, job.source, sendId});
+    ++send.left;
+    if (!send.data.empty()) {
+      post(client.Isend(send.data.data(), send.data.size(), MPI::DOUBLE,
+                        job.source, TAG_PAYLOAD),
+           {Event::Sent, job.conn, job.source, sendId});
+      ++send.left;
+    }
+    jobs_.erase(id);
+  }
+
+  void onSent(long long sendId) {
+    auto &send = sends_[sendId];
+    if (--send.left > 0)
+      return;
+    auto &conn = *send.conn;
+    sends_.erase(sendId);
+    --conn.outstanding;
+    closeIfDone(conn);
+  }
+
+  void closeIfDone(Connection &conn) {
+    if (conn.open > 0 || conn.outstanding > 0)
+      return;
+    conn.comm.Disconnect();
+    conns_.remove_if([&](const Connection &c) { return &c == &conn; });
+  }
+
+  const MPI::Intracomm &comm_;
+  const char *port_;
+  const char *self_;
+
+  // Shared with the acceptor thread
+  std::mutex mutex_{};
+  std::vector<MPI::Intercomm> accepted_{};
+  bool stopping_ = false;
+  MPI::Group knocker_{};
+  // Accept is collective: a communicator of its own, so that it never runs
+  // at the same time as the main thread's Spawn over COMM_SELF
+  MPI::Intracomm acceptComm_;
+  MPI::Intracomm wake_;
+  int wakeBuf_ = 0;
+  std::thread acceptor_{};
+
+  std::vector<MPI::Request> reqs_{};
+  std::vector<Posted> posted_{};
+  std::list<Connection> conns_{};
+  std::map<long long, Job> jobs_{};
+  std::deque<long long> ready_{};
+  std::vector<int> idle_{};
+  std::map<long long, PendingSend> sends_{};
+  long long nextJob_ = 0;
+  long long nextSend_ = 0;
+  bool shutdown_ = false;
+};
+
+// Worker rank: run jobs from rank 0 until told to stop
+void work(const MPI::Intracomm &comm) {
+  for (;;) {
+    Request req{};
+    comm.Recv(&req, sizeof(req), MPI::BYTE, 0, TAG_JOB);
+    if (req.kind == JobKind::Shutdown)
+      return;
+
+    std::vector<double> data(payloadSize(req));
+    if (!data.empty())
+      comm.Recv(data.data(), data.size(), MPI::DOUBLE, 0, TAG_PAYLOAD);
+    auto resp = runJob(req, data);
+    comm.Send(&resp, sizeof(resp), MPI::BYTE, 0, TAG_RESPONSE);
+    if (resp.n > 0)
+      comm.Send(data.data(), data.size(), MPI::DOUBLE, 0, TAG_PAYLOAD);
+  }
+}
+
+// Connect to the server's port and leave, to wake up its acceptor, once
+// the server is ready to tell us from its clients
+void knock(const char *port_name) {
+  auto parent = MPI::Comm::Get_parent();
+  parent.Recv(nullptr, 0, MPI::BYTE, 0, 0);
+  auto server = MPI::COMM_SELF.Connect(port_name, MPI::INFO_NULL, 0);
+  server.Disconnect();
+  parent.Disconnect();
+}
+
 int main(int ac, char **av) {
-  MPI::Init(ac, av);
+  auto provided = MPI::Init_thread(ac, av, MPI::THREAD_MULTIPLE);
+  auto &comm = MPI::COMM_WORLD;
+
+  if (ac == 3 && std::string_view{av[1]} == "--knock") {
+    knock(av[2]);
+    MPI::Finalize();
+    return 0;
+  }
+
+  if (comm.Get_rank() != 0) {
+    work(comm);
+    MPI::Finalize();
+    return 0;
+  }
+  if (provided < MPI::THREAD_MULTIPLE) {
+    std::cerr << "server: MPI without MPI_THREAD_MULTIPLE" << std::endl;
+    comm.Abort(1);
+  }
 
   // Open port.
   char port_name[MPI_MAX_PORT_NAME];
   MPI::Open_port(MPI::INFO_NULL, port_name);
 
-  // Publish port name and accept client.
-  MPI::Publish_name("name", MPI::INFO_NULL, port_name);
-  auto client = MPI::COMM_WORLD.Accept(port_name, MPI::INFO_NULL, 0);
+  // Publish port name and tell whoever launched us that we are ready.
+  MPI::Publish_name(SERVICE_NAME, MPI::INFO_NULL, port_name);
+  std::cout << "server: " << comm.Get_size() - 1 << " workers at "
+            << port_name << std::endl;
+  auto parent = MPI::Comm::Get_parent();
+  if (parent != MPI::COMM_NULL)
+    parent.Send(port_name, MPI_MAX_PORT_NAME, MPI::CHAR, 0, 0);
 
-  // Receive data from client.
-  int recvbuf{};
-  client.Recv(&recvbuf, 1, MPI::INT, 0, 0);
-  std::cout << "server: recvbuf equals to " << recvbuf << std::endl;
+  // Serve clients until one of them shuts us down.
+  {
+    Server server{comm, port_name, av[0]};
+    server.run();
+  }
 
-  MPI::Unpublish_name("name", MPI::INFO_NULL, port_name);
+  MPI::Unpublish_name(SERVICE_NAME, MPI::INFO_NULL, port_name);
+  MPI::Close_port(port_name);
 
   MPI::Finalize();
   return 0;
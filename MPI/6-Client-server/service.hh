@@ -0,0 +1,201 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <mpi.h>
+
+#include "harmonic_engine.hh"
+
+// Protocol of the compute service.
+//
+// Every process of a new client first receives a greeting, a Response
+// (TAG_RESPONSE) with id GREETING_ID: ok if the service takes its jobs, not
+// ok if the service is shutting down, in which case the client disconnects
+// without sending anything.
+//
+// A client then sends its requests in batches: one message of up to MAX_BATCH
+// Request structures (TAG_BATCH), followed by the input array of every
+// sort request in the batch, in batch order (TAG_PAYLOAD). An empty batch
+// says goodbye. Every request is answered by one Response (TAG_RESPONSE),
+// followed by the sorted array for a sort (TAG_PAYLOAD). Responses come in
+// the order the jobs finish, not the order they were sent; the client tells
+// them apart by the id it gave the request.
+//
+// The server hands the jobs to its worker ranks with the same messages,
+// one Request (TAG_JOB) and its input at a time.
+
+constexpr const char *SERVICE_NAME = "mpi-compute";
+
+constexpr int MAX_BATCH = 64;
+
+constexpr long long GREETING_ID = -1;
+
+constexpr int TAG_BATCH = 1;
+constexpr int TAG_PAYLOAD = 2;
+constexpr int TAG_RESPONSE = 3;
+constexpr int TAG_JOB = 4;
+
+// Kinds of jobs:
+//   harmonic - H_n, exactly or with the hybrid engine if tolerance a > 0
+//   sort     - sort an array of n doubles sent along with the request
+//   integral - integral of sin(1 / (x + 5)) over [a, b] by Simpson's rule
+//              on n intervals
+//   shutdown - stop the service once the current clients are done
+enum class JobKind : int { Harmonic, Sort, Integral, Shutdown };
+
+constexpr JobKind ALL_JOB_KINDS[] = {JobKind::Harmonic, JobKind::Sort,
+                                     JobKind::Integral, JobKind::Shutdown};
+
+inline const char *jobKindName(JobKind kind) {
+  switch (kind) {
+  case JobKind::Harmonic:
+    return "harmonic";
+  case JobKind::Sort:
+    return "sort";
+  case JobKind::Integral:
+    return "integral";
+  case JobKind::Shutdown:
+    return "shutdown";
+  }
+  return "unknown";
+}
+
+inline bool parseJobKind(std::string_view name, JobKind &kind) {
+  for (auto k : ALL_JOB_KINDS)
+    if (name == jobKindName(k)) {
+      kind = k;
+      return true;
+    }
+  return false;
+}
+
+struct Request {
+  long long id = 0;
+  JobKind kind = JobKind::Harmonic;
+  long long n = 0; // N, array size or number of intervals
+  double a = 0;    // tolerance or lower limit
+  double b = 0;    // upper limit
+};
+
+struct Response {
+  long long id = 0;
+  int ok = 0;
+  int worker = 0;   // rank of the server that ran the job
+  long long n = 0;  // doubles in the payload that follows
+  double value = 0; // H_n, the integral, or the array's first element
+  double error = 0; // bound on the error of value, estimate for an integral
+  double seconds = 0;
+};
+
+// Job as written on the client's command line: harmonic:N[:tol], sort:n,
+// integral:a:b:n or shutdown. N takes the 1e18 form of parseIndex too.
+inline bool parseRequest(std::string_view spec, Request &req) {
+  std::vector<std::string> fields{};
+  while (!spec.empty()) {
+    auto colon = std::min(spec.find(':'), spec.size());
+    fields.emplace_back(spec.substr(0, colon));
+    spec.remove_prefix(std::min(colon + 1, spec.size()));
+  }
+  if (fields.empty() || !parseJobKind(fields[0], req.kind))
+    return false;
+  // The whole field or nothing
+  auto num = [&](std::size_t i, auto &x) {
+    auto &f = fields[i];
+    auto [end, err] = std::from_chars(f.data(), f.data() + f.size(), x);
+    return err == std::errc{} && end == f.data() + f.size();
+  };
+  switch (req.kind) {
+  case JobKind::Harmonic: {
+    HarmonicIndex N = 0;
+    if ((fields.size() != 2 && fields.size() != 3) ||
+        !parseIndex(fields[1], N) ||
+        N > static_cast<HarmonicIndex>(INT64_MAX))
+      return false;
+    req.n = static_cast<long long>(N);
+    req.a = 0;
+    if (fields.size() == 3 && !num(2, req.a))
+      return false;
+    return req.n > 0 && req.a >= 0;
+  }
+  case JobKind::Sort:
+    if (fields.size() != 2 || !num(1, req.n))
+      return false;
+    return req.n >= 0 && req.n < INT32_MAX;
+  case JobKind::Integral:
+    if (fields.size() != 4 || !num(1, req.a) || !num(2, req.b) ||
+        !num(3, req.n))
+      return false;
+    return req.n > 0 && req.a > -5 && req.b > -5;
+  case JobKind::Shutdown:
+    return fields.size() == 1;
+  }
+  return false;
+}
+
+// Doubles sent along with a request of this kind
+inline long long payloadSize(const Request &req) {
+  return (req.kind == JobKind::Sort) ? req.n : 0;
+}
+
+inline double simpson(double a, double b, long long n) {
+  auto f = [](double x) { return std::sin(1 / (x + 5)); };
+  auto h = (b - a) / n;
+  auto sum = f(a) + f(b);
+  for (long long i = 1; i < n; ++i)
+    sum += f(a + i * h) * ((i % 2) ? 4 : 2);
+  return sum * h / 3;
+}
+
+// Run one job; a sort leaves its result in data
+inline Response runJob(const Request &req, std::vector<double> &data) {
+  Response resp{};
+  resp.id = req.id;
+  resp.ok = 1;
+  auto start = MPI::Wtime();
+  switch (req.kind) {
+  case JobKind::Harmonic: {
+    HarmonicOptions opts{};
+    opts.N = req.n;
+    if (req.a > 0) {
+      opts.engine = HarmonicEngine::Hybrid;
+      opts.tol = req.a;
+    } else if (opts.N >= HARMONIC_EXACT_MAX) {
+      resp.ok = 0;
+      break;
+    }
+    auto res = harmonicFinish(
+        opts, harmonicSum(1, harmonicHeadEnd(opts)).value());
+    resp.value = res.sum;
+    resp.error = res.bound;
+    break;
+  }
+  case JobKind::Sort:
+    std::sort(data.begin(), data.end());
+    resp.n = data.size();
+    resp.value = data.empty() ? 0 : data.front();
+    break;
+  case JobKind::Integral: {
+    // Halving the intervals makes Simpson's error about 16 times smaller:
+    // the difference from the rule on half as many intervals (twice as
+    // many if half is odd) estimates it
+    auto n = req.n + req.n % 2;
+    resp.value = simpson(req.a, req.b, n);
+    if (n % 4 == 0)
+      resp.error = std::fabs(resp.value - simpson(req.a, req.b, n / 2)) / 15;
+    else
+      resp.error =
+          std::fabs(simpson(req.a, req.b, 2 * n) - resp.value) * 16 / 15;
+    break;
+  }
+  case JobKind::Shutdown:
+    break;
+  }
+  resp.seconds = MPI::Wtime() - start;
+  return resp;
+}
@@ -1,37 +1,59 @@
+#include <cstdint>
+#include <iomanip>
 #include <iostream>
+#include <limits>
+#include <string_view>
+#include <vector>
 
 #include <mpi.h>
 
-using T = double;
+#include "harmonic_engine.hh"
+#include "rma.hh"
+
+using T = Compensated;
 
 int main(int ac, char **av) {
-  if (ac < 2) {
-    std::cout << "USAGE: " << av[0] << " N" << std::endl;
+  auto sync = Sync::Fence;
+  HarmonicIndex N = 0;
+  if ((ac != 2 &&
+       (ac != 4 || std::string_view{av[2]} != "--sync" ||
+        !parseSync(av[3], sync))) ||
+      !parseIndex(av[1], N) || N >= HARMONIC_EXACT_MAX) {
+    std::cout << "USAGE: " << av[0] << " N [--sync fence|pscw|lock]"
+              << std::endl;
     return 0;
   }
 
-  auto N = atoi(av[1]);
   MPI::Init(ac, av);
 
   auto commSize = MPI::COMM_WORLD.Get_size();
   auto rank = MPI::COMM_WORLD.Get_rank();
 
-  double sum = 0;
-  for (auto n = rank + 1; n <= N; n += commSize) {
-    sum += 1.0 / n;
+  auto [first, last] =
+      harmonicRange(static_cast<std::int64_t>(N), commSize, rank);
+  auto sum = harmonicSum(first, last);
+
+  /* Every rank puts its compensated partial sum into its own slot on rank
+   * 0, which adds them up in rank order */
+  std::vector<T> slots(rank == 0 ? commSize : 0);
+  auto win = MPI::Win::Create(slots.data(), slots.size() * sizeof(T),
+                              sizeof(T), MPI::INFO_NULL, MPI::COMM_WORLD);
+
+  {
+    RmaEpoch epoch{win, sync, 0, MPI::COMM_WORLD};
+    epoch.begin();
+    win.Put(&sum, 1, compensatedType(), 0, rank, 1, compensatedType());
+    epoch.end();
   }
 
-  auto win = MPI::Win::Create(&sum, sizeof(T), sizeof(T), MPI::INFO_NULL,
-                              MPI::COMM_WORLD);
-
-  win.Fence(0);
-  if (rank != 0)
-    win.Accumulate(&sum, 1, MPI::DOUBLE, 0, 0, 1, MPI::DOUBLE, MPI::SUM);
-  win.Fence(0);
-
   if (0 == rank) {
-    std::cout << "N = " << N << std::endl;
-    std::cout << "sum = " << sum << std::endl;
+    T total{};
+    for (auto &s : slots)
+      total.add(s);
+    std::cout << "N = " << indexString(N) << std::endl;
+    std::cout << "sum = "
+              << std::setprecision(std::numeric_limits<double>::max_digits10)
+              << total.value() << std::endl;
   }
 
   win.Free();
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <algorithm>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include <mpi.h>
+
+#include "topology.hh"
+
+/* One-sided reductions into a window on a single target rank.
+ *
+ * Synchronization of the access epochs:
+ *   fence - collective MPI_Win_fence around the operations
+ *   pscw  - the target posts an exposure epoch for all the processes,
+ *           which start access epochs to the target alone
+ *   lock  - one passive epoch on all targets for the life of the window
+ *           (MPI_Win_lock_all), operations completed by MPI_Win_flush and
+ *           a barrier
+ *
+ * The passive mode is MPI-3 and has no C++ bindings, so it goes through
+ * the C API. */
+
+enum class Sync { Fence, Pscw, Lock };
+
+constexpr Sync ALL_SYNCS[] = {Sync::Fence, Sync::Pscw, Sync::Lock};
+
+inline const char *syncName(Sync sync) {
+  switch (sync) {
+  case Sync::Fence:
+    return "fence";
+  case Sync::Pscw:
+    return "pscw";
+  case Sync::Lock:
+    return "lock";
+  }
+  return "unknown";
+}
+
+inline bool parseSync(std::string_view name, Sync &sync) {
+  for (auto s : ALL_SYNCS)
+    if (name == syncName(s)) {
+      sync = s;
+      return true;
+    }
+  return false;
+}
+
+/* How the contributions reach the root:
+ *   flat - every process accumulates into the root directly
+ *   hier - into the leader (lowest rank) of its node first, the leaders
+ *          then into the root, so that the root is hit once per node */
+enum class Layout { Flat, Hier };
+
+constexpr Layout ALL_LAYOUTS[] = {Layout::Flat, Layout::Hier};
+
+inline const char *layoutName(Layout layout) {
+  return (layout == Layout::Flat) ? "flat" : "hier";
+}
+
+inline bool parseLayout(std::string_view name, Layout &layout) {
+  for (auto l : ALL_LAYOUTS)
+    if (name == layoutName(l)) {
+      layout = l;
+      return true;
+    }
+  return false;
+}
+
+/* Access epochs of all processes of a window's communicator to the target
+ * root. Between begin() and end() every process may access root's window;
+ * after end() returns on root, all the accesses are complete there. */
+class RmaEpoch {
+public:
+  RmaEpoch(MPI::Win &win, Sync sync, int root, const MPI::Intracomm &comm)
+      : win_(win), sync_(sync), root_(root), comm_(comm),
+        isRoot_(comm.Get_rank() == root) {
+    if (sync_ == Sync::Pscw) {
+      all_ = comm.Get_group();
+      target_ = all_.Incl(1, &root_);
+    } else if (sync_ == Sync::Lock) {
+      MPI_Win_lock_all(MPI_MODE_NOCHECK, win_);
+    }
+  }
+
+  RmaEpoch(const RmaEpoch &) = delete;
+  RmaEpoch &operator=(const RmaEpoch &) = delete;
+
+  ~RmaEpoch() {
+    if (sync_ == Sync::Pscw) {
+      target_.Free();
+      all_.Free();
+    } else if (sync_ == Sync::Lock) {
+      MPI_Win_unlock_all(win_);
+    }
+  }
+
+  /* Local stores to root's window made before begin() are visible to the
+   * accesses of the epoch */
+  void begin() {
+    switch (sync_) {
+    case Sync::Fence:
+      win_.Fence(MPI::MODE_NOPRECEDE);
+      break;
+    case Sync::Pscw:
+      if (isRoot_)
+        win_.Post(all_, 0);
+      win_.Start(target_, 0);
+      break;
+    case Sync::Lock:
+      if (isRoot_)
+        MPI_Win_sync(win_);
+      comm_.Barrier();
+      break;
+    }
+  }
+
+  void end() {
+    switch (sync_) {
+    case Sync::Fence:
+      win_.Fence(MPI::MODE_NOSUCCEED);
+      break;
+    case Sync::Pscw:
+      win_.Complete();
+      if (isRoot_)
+        win_.Wait();
+      break;
+    case Sync::Lock:
+      MPI_Win_flush(root_, win_);
+      comm_.Barrier();
+      if (isRoot_)
+        MPI_Win_sync(win_);
+      break;
+    }
+  }
+
+private:
+  MPI::Win &win_;
+  Sync sync_;
+  int root_;
+  const MPI::Intracomm &comm_;
+  bool isRoot_;
+  MPI::Group all_{};
+  MPI::Group target_{};
+};
+
+/* Largest accumulate issued at once; longer arrays go in pieces so that
+ * the implementation can pipeline them instead of staging one message */
+constexpr int RMA_CHUNK = 1 << 16;
+
+/* Element-wise sum of arrays of count doubles from all processes of comm
+ * into a window on root, one epoch per reduction */
+class RmaSum {
+public:
+  RmaSum(int count, Sync sync, int root, const MPI::Intracomm &comm)
+      : count_(count), root_(root),
+        target_(comm.Get_rank() == root ? count : 0),
+        win_(MPI::Win::Create(target_.data(), target_.size() * sizeof(double),
+                              sizeof(double), MPI::INFO_NULL, comm)) {
+    epoch_.emplace(win_, sync, root, comm);
+  }
+
+  RmaSum(const RmaSum &) = delete;
+  RmaSum &operator=(const RmaSum &) = delete;
+
+  ~RmaSum() {
+    epoch_.reset(); /* ends a passive epoch before the window goes */
+    win_.Free();
+  }
+
+  /* Returns the sum on root, an empty vector elsewhere */
+  const std::vector<double> &reduce(const double *x) {
+    std::fill(target_.begin(), target_.end(), 0.0);
+    epoch_->begin();
+    for (int i = 0; i < count_; i += RMA_CHUNK) {
+      auto n = std::min(RMA_CHUNK, count_ - i);
+      win_.Accumulate(x + i, n, MPI::DOUBLE, root_, i, n, MPI::DOUBLE,
+                      MPI::SUM);
+    }
+    epoch_->end();
+    return target_;
+  }
+
+private:
+  int count_;
+  int root_;
+  std::vector<double> target_;
+  MPI::Win win_;
+  std::optional<RmaEpoch> epoch_{};
+};
+
+/* RmaSum over comm with results on rank 0 of comm, flat or through the
+ * node leaders */
+class RmaReducer {
+public:
+  RmaReducer(int count, Sync sync, Layout layout, const MPI::Intracomm &comm)
+      : hier_(layout == Layout::Hier) {
+    if (!hier_) {
+      global_.emplace(count, sync, 0, comm);
+      return;
+    }
+    topo_.emplace(comm);
+    local_.emplace(count, sync, 0, topo_->node());
+    if (topo_->isLeader())
+      global_.emplace(count, sync, 0, topo_->leaders());
+  }
+
+  RmaReducer(const RmaReducer &) = delete;
+  RmaReducer &operator=(const RmaReducer &) = delete;
+
+  /* Number of nodes, significant on rank 0 */
+  int nodes() const { return hier_ ? topo_->nodes() : 1; }
+
+  /* Returns the sum on rank 0 of comm, an empty vector elsewhere */
+  const std::vector<double> &reduce(const double *x) {
+    if (!hier_)
+      return global_->reduce(x);
+    auto &nodeSum = local_->reduce(x);
+    if (!global_)
+      return nodeSum;
+    return global_->reduce(nodeSum.data());
+  }
+
+private:
+  bool hier_;
+  /* Declared first so that it goes last */
+  std::optional<Topology> topo_{};
+  std::optional<RmaSum> local_{};
+  std::optional<RmaSum> global_{};
+};
@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <mpi.h>
+
+#include "rma.hh"
+
+/* Element-wise sum of an array of doubles from every rank into rank 0, by
+ * MPI_Reduce and by accumulates under every synchronization mode and
+ * layout, one CSV row per run: mean time of one reduction over a number of
+ * iterations, the root's incoming data rate, count * procs * 8 bytes per
+ * reduction, and whether the sums came out right. */
+
+struct BenchOptions {
+  std::vector<int> counts{};
+  std::vector<Sync> syncs{std::begin(ALL_SYNCS), std::end(ALL_SYNCS)};
+  std::vector<Layout> layouts{std::begin(ALL_LAYOUTS),
+                              std::end(ALL_LAYOUTS)};
+  int iters = 10;
+  int repeat = 3;
+  const char *csv = nullptr; /* stdout if not given */
+};
+
+bool parseOptions(int ac, char **av, BenchOptions &opts);
+std::string runReduce(const BenchOptions &opts, int count, int rep,
+                      MPI::Intracomm &comm);
+std::string runRma(const BenchOptions &opts, Sync sync, Layout layout,
+                   int count, int rep, MPI::Intracomm &comm);
+
+int main(int ac, char **av) {
+  MPI::Init(ac, av);
+  auto &comm = MPI::COMM_WORLD;
+  auto rank = comm.Get_rank();
+
+  BenchOptions opts{};
+  if (!parseOptions(ac, av, opts)) {
+    if (rank == 0)
+      std::cerr << "Usage: " << av[0]
+                << " count1[,count2,...] [--syncs fence,pscw,lock]"
+                   " [--layouts flat,hier] [--iters N] [--repeat N]"
+                   " [--csv file]"
+                << std::endl;
+    comm.Abort(1);
+  }
+
+  std::ofstream file{};
+  if (rank == 0 && opts.csv)
+    file.open(opts.csv);
+  std::ostream &out = (opts.csv) ? file : std::cout;
+  if (rank == 0)
+    out << "method,layout,procs,nodes,count,rep,time,bytes_per_sec,ok"
+        << std::endl;
+
+  for (auto count : opts.counts)
+    for (int rep = 0; rep < opts.repeat; ++rep) {
+      auto row = runReduce(opts, count, rep, comm);
+      if (rank == 0)
+        out << row << std::endl;
+      for (auto sync : opts.syncs)
+        for (auto layout : opts.layouts) {
+          row = runRma(opts, sync, layout, count, rep, comm);
+          if (rank == 0)
+            out << row << std::endl;
+        }
+    }
+
+  MPI::Finalize();
+  return 0;
+}
+
+/* Comma-separated list of items known to parse */
+template <typename E, typename Parse>
+bool parseList(std::string_view list, std::vector<E> &items, Parse parse) {
+  items.clear();
+  while (!list.empty()) {
+    auto comma = std::min(list.find(','), list.size());
+    E item{};
+    if (!parse(list.substr(0, comma), item))
+      return false;
+    items.push_back(item);
+    list.remove_prefix(std::min(comma + 1, list.size()));
+  }
+  return !items.empty();
+}
+
+bool parseOptions(int ac, char **av, BenchOptions &opts) {
+  if (ac < 2)
+    return false;
+
+  auto parseCount = [](std::string_view s, int &count) {
+    auto [end, err] = std::from_chars(s.data(), s.data() + s.size(), count);
+    return err == std::errc{} && end == s.data() + s.size() && count > 0;
+  };
+  if (!parseList(av[1], opts.counts, parseCount))
+    return false;
+
+  for (int i = 2; i < ac; ++i) {
+    std::string_view arg = av[i];
+    if (i + 1 == ac)
+      return false;
+    std::string_view val = av[++i];
+    if (arg == "--syncs" && parseList(val, opts.syncs, parseSync))
+      continue;
+    else if (arg == "--layouts" && parseList(val, opts.layouts, parseLayout))
+      continue;
+    else if (arg == "--iters")
+      opts.iters = atoi(av[i]);
+    else if (arg == "--repeat")
+      opts.repeat = atoi(av[i]);
+    else if (arg == "--csv")
+      opts.csv = av[i];
+    else
+      return false;
+  }
+  return opts.iters > 0 && opts.repeat > 0;
+}
+
+/* Every rank's contribution; small integers, so that any order of
+ * summation gives the exact sum */
+std::vector<double> contribution(int count, int rank) {
+  std::vector<double> x(count);
+  for (int i = 0; i < count; ++i)
+    x[i] = rank + i % 8;
+  return x;
+}
+
+bool isExpectedSum(const std::vector<double> &sum, int commSize) {
+  double ranks = static_cast<double>(commSize) * (commSize - 1) / 2;
+  for (int i = 0; i < static_cast<int>(sum.size()); ++i)
+    if (sum[i] != ranks + static_cast<double>(commSize) * (i % 8))
+      return false;
+  return true;
+}
+
+/* CSV row of one run */
+std::string row(std::string_view method, std::string_view layout,
+                int commSize, int nodes, int count, int rep, double time,
+                bool ok) {
+  std::ostringstream row{};
+  row << method << ',' << layout << ',' << commSize << ',' << nodes << ','
+      << count << ',' << rep << ',' << time << ','
+      << static_cast<double>(count) * commSize * sizeof(double) / time << ','
+      << ok;
+  return row.str();
+}
+
+/* Reductions by MPI_Reduce and their CSV row (on rank 0) */
+std::string runReduce(const BenchOptions &opts, int count, int rep,
+                      MPI::Intracomm &comm) {
+  auto rank = comm.Get_rank();
+  auto x = contribution(count, rank);
+  std::vector<double> sum(rank == 0 ? count : 0);
+
+  comm.Barrier();
+  auto start = MPI::Wtime();
+  for (int it = 0; it < opts.iters; ++it)
+    comm.Reduce(x.data(), sum.data(), count, MPI::DOUBLE, MPI::SUM, 0);
+  comm.Barrier();
+  auto time = (MPI::Wtime() - start) / opts.iters;
+
+  if (rank != 0)
+    return {};
+  return row("reduce", "flat", comm.Get_size(), 1, count, rep, time,
+             isExpectedSum(sum, comm.Get_size()));
+}
+
+/* Reductions by accumulates and their CSV row (on rank 0). Creating the
+ * windows and communicators is not timed. */
+std::string runRma(const BenchOptions &opts, Sync sync, Layout layout,
+                   int count, int rep, MPI::Intracomm &comm) {
+  auto rank = comm.Get_rank();
+  auto x = contribution(count, rank);
+  RmaReducer reducer{count, sync, layout, comm};
+
+  comm.Barrier();
+  auto start = MPI::Wtime();
+  const std::vector<double> *sum{};
+  for (int it = 0; it < opts.iters; ++it)
+    sum = &reducer.reduce(x.data());
+  comm.Barrier();
+  auto time = (MPI::Wtime() - start) / opts.iters;
+
+  if (rank != 0)
+    return {};
+  return row(syncName(sync), layoutName(layout), comm.Get_size(),
+             reducer.nodes(), count, rep, time,
+             isExpectedSum(*sum, comm.Get_size()));
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+
+#include <mpi.h>
+
+#include "mpi_type.hh"
+#include "rng.hh"
+#include "sample_sort.hh"
+
+/* Write the distributed sorted array to one binary file of native elements
+ * with parallel MPI-IO: every rank writes its bucket at the offset given by
+ * the sizes of the buckets on lower ranks. */
+template <typename T>
+bool writeDistributed(const std::vector<T> &a, const char *path,
+                      MPI::Intracomm &comm) {
+  long long size = a.size();
+  long long offset = 0;
+  comm.Exscan(&size, &offset, 1, MPI::LONG_LONG, MPI::SUM);
+  if (comm.Get_rank() == 0)
+    offset = 0; /* Exscan leaves rank 0's buffer undefined */
+
+  MPI_File fh;
+  auto err = MPI_File_open(comm, path, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                           MPI_INFO_NULL, &fh);
+  if (err != MPI_SUCCESS)
+    return false;
+
+  MPI_File_set_size(fh, 0);
+  err = MPI_File_write_at_all(fh, offset * sizeof(T), a.data(), a.size(),
+                              mpiType<T>(), MPI_STATUS_IGNORE);
+  MPI_File_close(&fh);
+  return err == MPI_SUCCESS;
+}
+
+/* Scatter rank 0's array in equal contiguous blocks */
+template <typename T>
+std::vector<T> distribute(const std::vector<T> &a, long long arrSize,
+                          MPI::Intracomm &comm) {
+  auto commSize = comm.Get_size();
+
+  std::vector<int> counts(commSize);
+  for (int i = 0; i < commSize; ++i)
+    counts[i] = blockRange(arrSize, commSize, i).second;
+  auto displs = displacements(counts);
+
+  std::vector<T> part(counts[comm.Get_rank()]);
+  auto type = mpiType<T>();
+  comm.Scatterv(a.data(), counts.data(), displs.data(), type, part.data(),
+                part.size(), type, 0);
+  return part;
+}
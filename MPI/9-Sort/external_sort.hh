@@ -0,0 +1,555 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+
+#include "local_sort.hh"
+#include "loser_tree.hh"
+#include "mpi_type.hh"
+#include "parallel_sort.hh"
+#include "rng.hh"
+#include "sample_sort.hh"
+#include "thread_pool.hh"
+
+/* Out-of-core sample sort for data sets larger than the aggregate memory.
+ *
+ * 1. Runs: every rank produces its block in chunks that fit the memory
+ *    budget, sorts every chunk and writes it to a scratch file; a chunk is
+ *    sorted while the previous one is still being written.
+ * 2. Splitters: regular samples of all runs, chosen as in sampleSort.
+ * 3. Exchange: every rank merges its runs from disk with a loser tree and
+ *    streams the output to the owners of the buckets, which append what
+ *    they receive from every rank to a scratch file of its own.
+ * 4. Final merge: every rank merges the runs received from all ranks from
+ *    disk into the output file, at the offset of its bucket.
+ *
+ * All file I/O is in large sequential blocks through nonblocking MPI-IO
+ * with two buffers per file: the program fills or drains one while the
+ * other is in flight. Scratch files go to a per-rank directory, e.g. on a
+ * local NVMe drive, and are deleted as soon as they have been read. A file
+ * that cannot be opened, written or read ends the sort on all ranks at the
+ * next phase boundary, with its path in the failing rank's result. */
+
+constexpr int EXT_MIN_BLOCK = 1 << 12;  /* elements per I/O block, at least */
+constexpr int EXT_MAX_BLOCK = 1 << 24;  /* and at most */
+constexpr long long EXT_MAX_RUN = 1 << 30; /* elements per run, at most */
+constexpr int EXT_TAG = 92;
+
+struct ExternalConfig {
+  long long memBytes;  /* memory budget per rank */
+  std::string scratch; /* directory for the scratch files */
+  Dist dist = Dist::Uniform;
+};
+
+/* This rank's part of an external sort */
+template <typename T> struct ExternalResult {
+  long long count = 0;         /* elements in the bucket */
+  std::uint64_t inputSum = 0;  /* of the elements generated here */
+  std::uint64_t outputSum = 0; /* of the elements of the bucket */
+  bool sorted = true;
+  T first{};
+  T last{};
+  int runs = 0;
+  double runTime = 0;
+  double exchangeTime = 0;
+  double mergeTime = 0;
+  std::string failed{}; /* file that failed on this rank, if any */
+  bool ok = true;       /* no file failed on any rank */
+};
+
+/* Whether a file has failed on any rank. Collective. */
+template <typename T>
+bool anyFailed(ExternalResult<T> &res, MPI::Intracomm &comm) {
+  int failed = !res.failed.empty();
+  int any = 0;
+  comm.Allreduce(&failed, &any, 1, MPI::INT, MPI::LOR);
+  res.ok = !any;
+  return any;
+}
+
+/* I/O block for files sharing the budget with numBlocks other blocks */
+template <typename T> int ioBlock(long long memBytes, long long numBlocks) {
+  auto block = memBytes / (static_cast<long long>(sizeof(T)) * numBlocks);
+  return std::clamp<long long>(block, EXT_MIN_BLOCK, EXT_MAX_BLOCK);
+}
+
+inline std::string scratchPath(const ExternalConfig &cfg, const char *what,
+                               int rank, int i) {
+  return cfg.scratch + "/sort." + std::to_string(rank) + "." + what + "." +
+         std::to_string(i);
+}
+
+/* File written front to back in blocks from base on: one block is filled
+ * while the previous one is being written */
+template <typename T> class BlockWriter {
+public:
+  /* Scratch file of this rank alone */
+  BlockWriter(const std::string &path, int blockSize) : owner_(true) {
+    check(MPI_File_open(MPI_COMM_SELF, path.c_str(),
+                        MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL,
+                        &fh_));
+    if (ok_)
+      check(MPI_File_set_size(fh_, 0));
+    reserve(blockSize);
+  }
+
+  /* Part of a file opened by the caller */
+  BlockWriter(MPI_File fh, long long base, int blockSize)
+      : fh_(fh), base_(base) {
+    reserve(blockSize);
+  }
+
+  void push(const T &v) {
+    buf_[active_].push_back(v);
+    if (buf_[active_].size() == buf_[active_].capacity())
+      flush();
+  }
+
+  void append(const T *data, int n) {
+    while (n > 0) {
+      auto &b = buf_[active_];
+      int take = std::min<std::size_t>(n, b.capacity() - b.size());
+      b.insert(b.end(), data, data + take);
+      data += take;
+      n -= take;
+      if (b.size() == b.capacity())
+        flush();
+    }
+  }
+
+  /* Write what is left and wait for it; returns the elements written */
+  long long close() {
+    flush();
+    for (auto &r : req_)
+      check(MPI_Wait(&r, MPI_STATUS_IGNORE));
+    if (owner_ && fh_ != MPI_FILE_NULL)
+      check(MPI_File_close(&fh_));
+    return written_;
+  }
+
+  /* No MPI-IO call has failed so far */
+  bool ok() const { return ok_; }
+
+private:
+  void check(int err) {
+    if (err != MPI_SUCCESS)
+      ok_ = false;
+  }
+
+  void reserve(int blockSize) {
+    for (auto &b : buf_)
+      b.reserve(blockSize);
+  }
+
+  /* Start writing the active block and make the other one active */
+  void flush() {
+    auto &b = buf_[active_];
+    if (b.empty())
+      return;
+    if (ok_)
+      check(MPI_File_iwrite_at(fh_, (base_ + written_) * sizeof(T), b.data(),
+                               b.size(), mpiType<T>(), &req_[active_]));
+    written_ += b.size();
+    active_ ^= 1;
+    check(MPI_Wait(&req_[active_], MPI_STATUS_IGNORE));
+    buf_[active_].clear();
+  }
+
+  MPI_File fh_ = MPI_FILE_NULL;
+  bool owner_ = false;
+  bool ok_ = true;
+  long long base_ = 0;
+  long long written_ = 0;
+  std::vector<T> buf_[2];
+  MPI_Request req_[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+  int active_ = 0;
+};
+
+/* Sorted scratch file read as a loser-tree source: the next block is read
+ * while the current one is merged. The file is deleted on close. */
+template <typename T> class DiskSource {
+public:
+  DiskSource(const std::string &path, long long count, int blockSize)
+      : count_(count) {
+    check(MPI_File_open(MPI_COMM_SELF, path.c_str(),
+                        MPI_MODE_RDONLY | MPI_MODE_DELETE_ON_CLOSE,
+                        MPI_INFO_NULL, &fh_));
+    if (!ok_)
+      count_ = 0; /* nothing to read: an empty source */
+    for (auto &b : buf_)
+      b.resize(std::min<long long>(blockSize, count));
+    post(0);
+    post(1);
+    next();
+  }
+
+  bool empty() const { return cur_ == end_; }
+  const T &front() const { return *cur_; }
+  void pop() {
+    if (++cur_ == end_)
+      next();
+  }
+
+  void close() {
+    for (auto &r : req_)
+      check(MPI_Wait(&r, MPI_STATUS_IGNORE));
+    if (fh_ != MPI_FILE_NULL)
+      check(MPI_File_close(&fh_));
+  }
+
+  /* No MPI-IO call has failed so far */
+  bool ok() const { return ok_; }
+
+private:
+  void check(int err) {
+    if (err != MPI_SUCCESS)
+      ok_ = false;
+  }
+
+  /* Read the next block into buffer b */
+  void post(int b) {
+    len_[b] = std::min<long long>(buf_[b].size(), count_ - posted_);
+    if (len_[b] > 0)
+      check(MPI_File_iread_at(fh_, posted_ * sizeof(T), buf_[b].data(),
+                              len_[b], mpiType<T>(), &req_[b]));
+    posted_ += len_[b];
+  }
+
+  /* The active buffer is used up: refill it and switch to the other one */
+  void next() {
+    if (active_ >= 0)
+      post(active_);
+    active_ = (active_ + 1) % 2;
+    if (len_[active_] == 0)
+      return;
+    check(MPI_Wait(&req_[active_], MPI_STATUS_IGNORE));
+    cur_ = buf_[active_].data();
+    end_ = cur_ + len_[active_];
+  }
+
+  MPI_File fh_ = MPI_FILE_NULL;
+  bool ok_ = true;
+  long long count_;
+  long long posted_ = 0;
+  const T *cur_ = nullptr;
+  const T *end_ = nullptr;
+  int active_ = -1;
+  std::vector<T> buf_[2];
+  int len_[2] = {0, 0};
+  MPI_Request req_[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+};
+
+/* Scratch file holding a sorted run */
+struct RunFile {
+  std::string path;
+  long long count;
+};
+
+/* Delete the files of runs after a failure, ignoring errors: some of them
+ * may never have been created */
+inline void removeRuns(const std::vector<RunFile> &runs) {
+  for (auto &run : runs)
+    MPI_File_delete(run.path.c_str(), MPI_INFO_NULL);
+}
+
+/* Phase 1: this rank's block as sorted runs of at most a third of the
+ * budget each (run being sorted, its scratch space and the previous run
+ * being written). Samples of every run are added to samples. Stops at the
+ * first file that fails. */
+template <typename T, typename Cmp>
+std::vector<RunFile> formRuns(long long arrSize, const ExternalConfig &cfg,
+                              LocalSort kind, ThreadPool &pool, Cmp cmp,
+                              MPI::Intracomm &comm, ExternalResult<T> &res,
+                              std::vector<T> &samples) {
+  auto commSize = comm.Get_size();
+  auto rank = comm.Get_rank();
+  auto [start, count] = blockRange(arrSize, commSize, rank);
+  auto chunk = std::clamp<long long>(cfg.memBytes / (3 * sizeof(T)),
+                                     EXT_MIN_BLOCK, EXT_MAX_RUN);
+
+  std::vector<RunFile> runs{};
+  std::vector<T> run[2];
+  std::vector<T> tmp(std::min<long long>(chunk, count));
+  MPI_File fh[2];
+  MPI_Request req[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+  bool open[2] = {false, false};
+  std::string path[2];
+
+  auto check = [&](int err, int b) {
+    if (err != MPI_SUCCESS && res.failed.empty())
+      res.failed = path[b];
+  };
+  auto finish = [&](int b) {
+    check(MPI_Wait(&req[b], MPI_STATUS_IGNORE), b);
+    if (open[b])
+      check(MPI_File_close(&fh[b]), b);
+    open[b] = false;
+  };
+
+  for (long long lo = 0; lo < count; lo += chunk) {
+    int b = runs.size() % 2;
+    finish(b);
+    if (!res.failed.empty())
+      break;
+
+    int n = std::min<long long>(chunk, count - lo);
+    auto &a = run[b];
+    a.resize(n);
+    for (int i = 0; i < n; ++i) {
+      a[i] = makeElement<T>(start + lo + i, arrSize, cfg.dist);
+      res.inputSum += hashElement(a[i]);
+    }
+    parallelSort(a.begin(), tmp.begin(), n, kind, pool, cmp);
+    auto runSamples = regularSamples(a, commSize);
+    samples.insert(samples.end(), runSamples.begin(), runSamples.end());
+
+    path[b] = scratchPath(cfg, "run", rank, runs.size());
+    runs.push_back({path[b], n});
+    check(MPI_File_open(MPI_COMM_SELF, path[b].c_str(),
+                        MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL,
+                        &fh[b]),
+          b);
+    if (!res.failed.empty())
+      break;
+    open[b] = true;
+    check(MPI_File_set_size(fh[b], 0), b);
+    check(MPI_File_iwrite_at(fh[b], 0, a.data(), n, mpiType<T>(), &req[b]),
+          b);
+  }
+
+  for (int b = 0; b < 2; ++b)
+    finish(b);
+  return runs;
+}
+
+/* Phase 3: merge this rank's runs and send every element to the owner of
+ * its bucket, while appending the elements received from every rank to a
+ * scratch file per source. Messages are blocks of one bucket, an empty
+ * message ends a rank's stream. Returns the received runs, none if a file
+ * has failed on any rank. */
+template <typename T, typename Cmp>
+std::vector<RunFile> exchangeRuns(std::vector<RunFile> &runs,
+                                  const std::vector<T> &splitters,
+                                  const ExternalConfig &cfg, Cmp cmp,
+                                  MPI::Intracomm &comm,
+                                  ExternalResult<T> &res) {
+  auto commSize = comm.Get_size();
+  auto rank = comm.Get_rank();
+  auto type = mpiType<T>();
+  /* Two blocks per run read, per file written and for sending, one per
+   * receive. Every rank receives blocks of any other, so all size them for
+   * the largest number of runs. */
+  long long numRuns = runs.size();
+  long long maxRuns = 0;
+  comm.Allreduce(&numRuns, &maxRuns, 1, MPI::LONG_LONG, MPI::MAX);
+  auto block = ioBlock<T>(cfg.memBytes, 2 * maxRuns + 3 * commSize + 2);
+
+  std::vector<RunFile> received{};
+  std::vector<BlockWriter<T>> writers{};
+  writers.reserve(commSize);
+  for (int r = 0; r < commSize; ++r) {
+    received.push_back({scratchPath(cfg, "from", rank, r), 0});
+    writers.emplace_back(received.back().path, block);
+  }
+  std::vector<DiskSource<T>> sources{};
+  sources.reserve(runs.size());
+  for (auto &run : runs)
+    sources.emplace_back(run.path, run.count, block);
+
+  auto failed = [&] {
+    for (int r = 0; r < commSize; ++r)
+      if (!writers[r].ok() && res.failed.empty())
+        res.failed = received[r].path;
+    for (std::size_t i = 0; i < runs.size(); ++i)
+      if (!sources[i].ok() && res.failed.empty())
+        res.failed = runs[i].path;
+    return anyFailed(res, comm);
+  };
+  if (failed()) {
+    for (auto &source : sources)
+      source.close();
+    for (auto &writer : writers)
+      writer.close();
+    removeRuns(runs);
+    removeRuns(received);
+    return {};
+  }
+
+  std::vector<std::vector<T>> recvBuf(commSize, std::vector<T>(block));
+  std::vector<MPI::Request> recvs(commSize);
+  std::vector<char> receiving(commSize, 1);
+  auto streams = commSize;
+  for (int r = 0; r < commSize; ++r)
+    recvs[r] = comm.Irecv(recvBuf[r].data(), block, type, r, EXT_TAG);
+
+  /* Store whatever has arrived */
+  auto poll = [&] {
+    MPI::Status status{};
+    for (int r = 0; r < commSize; ++r) {
+      if (!receiving[r] || !recvs[r].Test(status))
+        continue;
+      auto n = status.Get_count(type);
+      if (n == 0) {
+        receiving[r] = 0;
+        --streams;
+        continue;
+      }
+      writers[r].append(recvBuf[r].data(), n);
+      recvs[r] = comm.Irecv(recvBuf[r].data(), block, type, r, EXT_TAG);
+    }
+  };
+
+  std::vector<T> sendBuf[2];
+  for (auto &b : sendBuf)
+    b.reserve(block);
+  MPI::Request sendReq[2];
+  bool sending[2] = {false, false};
+  int active = 0;
+  int dest = 0;
+
+  /* Receiving goes on while a send buffer is still busy, so that two ranks
+   * sending to each other cannot block */
+  auto waitSend = [&](int b) {
+    while (sending[b] && !sendReq[b].Test())
+      poll();
+    sending[b] = false;
+  };
+  auto flushSend = [&] {
+    auto &b = sendBuf[active];
+    if (b.empty())
+      return;
+    sendReq[active] = comm.Isend(b.data(), b.size(), type, dest, EXT_TAG);
+    sending[active] = true;
+    active ^= 1;
+    waitSend(active);
+    sendBuf[active].clear();
+  };
+
+  for (LoserTree<DiskSource<T>, Cmp> tree{sources, cmp}; !tree.empty();
+       tree.pop()) {
+    auto &v = tree.front();
+    while (dest < commSize - 1 && !cmp(v, splitters[dest])) {
+      flushSend();
+      ++dest;
+    }
+    sendBuf[active].push_back(v);
+    if (static_cast<int>(sendBuf[active].size()) == block)
+      flushSend();
+  }
+  flushSend();
+  for (int b = 0; b < 2; ++b)
+    waitSend(b);
+  for (auto &source : sources)
+    source.close();
+
+  std::vector<MPI::Request> ends{};
+  for (int r = 0; r < commSize; ++r)
+    ends.push_back(comm.Isend(sendBuf[0].data(), 0, type, r, EXT_TAG));
+  while (streams > 0)
+    poll();
+  MPI::Request::Waitall(ends.size(), ends.data());
+
+  for (int r = 0; r < commSize; ++r)
+    received[r].count = writers[r].close();
+  if (failed()) {
+    removeRuns(received);
+    return {};
+  }
+  return received;
+}
+
+/* Phase 4: merge the received runs into the output file, if any, at the
+ * offset of this rank's bucket, checking the order on the way. Collective,
+ * also in what it finds about failed files. */
+template <typename T, typename Cmp>
+void mergeReceived(std::vector<RunFile> &received, const ExternalConfig &cfg,
+                   const char *out, Cmp cmp, MPI::Intracomm &comm,
+                   ExternalResult<T> &res) {
+  long long size = 0;
+  for (auto &run : received)
+    size += run.count;
+  long long offset = 0;
+  comm.Exscan(&size, &offset, 1, MPI::LONG_LONG, MPI::SUM);
+  if (comm.Get_rank() == 0)
+    offset = 0; /* Exscan leaves rank 0's buffer undefined */
+
+  auto block = ioBlock<T>(cfg.memBytes, 2 * received.size() + 2);
+  MPI_File fh = MPI_FILE_NULL;
+  if (out && (MPI_File_open(comm, out, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                            MPI_INFO_NULL, &fh) != MPI_SUCCESS ||
+              MPI_File_set_size(fh, 0) != MPI_SUCCESS))
+    res.failed = out;
+  BlockWriter<T> writer{fh, offset, block};
+
+  std::vector<DiskSource<T>> sources{};
+  sources.reserve(received.size());
+  for (auto &run : received)
+    sources.emplace_back(run.path, run.count, block);
+  for (LoserTree<DiskSource<T>, Cmp> tree{sources, cmp}; !tree.empty();
+       tree.pop()) {
+    auto &v = tree.front();
+    if (res.count == 0)
+      res.first = v;
+    else if (cmp(v, res.last))
+      res.sorted = false;
+    res.last = v;
+    ++res.count;
+    res.outputSum += hashElement(v);
+    if (out)
+      writer.push(v);
+  }
+  for (std::size_t i = 0; i < sources.size(); ++i) {
+    sources[i].close();
+    if (!sources[i].ok() && res.failed.empty())
+      res.failed = received[i].path;
+  }
+
+  writer.close();
+  if (fh != MPI_FILE_NULL && MPI_File_close(&fh) != MPI_SUCCESS)
+    res.failed = out;
+  if (!writer.ok() && res.failed.empty())
+    res.failed = out;
+  anyFailed(res, comm);
+}
+
+/* Generate arrSize elements across the ranks and sort them within the
+ * memory budget of cfg, writing the result to out unless it is null. If a
+ * file fails, res.ok is false on every rank and the rest of res is not
+ * meaningful. */
+template <typename T, typename Cmp = std::less<>>
+ExternalResult<T> externalSort(long long arrSize, const ExternalConfig &cfg,
+                               LocalSort kind, const char *out,
+                               ThreadPool &pool, MPI::Intracomm &comm,
+                               Cmp cmp = {}) {
+  ExternalResult<T> res{};
+  auto start = MPI::Wtime();
+
+  std::vector<T> samples{};
+  auto runs = formRuns(arrSize, cfg, kind, pool, cmp, comm, res, samples);
+  res.runs = runs.size();
+  if (anyFailed(res, comm)) {
+    removeRuns(runs);
+    return res;
+  }
+  auto formed = MPI::Wtime();
+
+  std::sort(samples.begin(), samples.end(), cmp);
+  auto splitters =
+      chooseSplitters(regularSamples(samples, comm.Get_size()), cmp, comm);
+  auto received = exchangeRuns(runs, splitters, cfg, cmp, comm, res);
+  if (!res.ok)
+    return res;
+  auto exchanged = MPI::Wtime();
+
+  mergeReceived(received, cfg, out, cmp, comm, res);
+  auto merged = MPI::Wtime();
+
+  res.runTime = formed - start;
+  res.exchangeTime = exchanged - formed;
+  res.mergeTime = merged - exchanged;
+  return res;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <compare>
+#include <cstdint>
+#include <vector>
+
+#include <mpi.h>
+
+#include "local_sort.hh"
+#include "mpi_type.hh"
+#include "sample_sort.hh"
+
+/* Key extraction: instead of the elements themselves, the engines sort small
+ * (key, origin) pairs, and every element is then moved exactly once, from
+ * the rank holding it to the rank and position its key was sorted to. The
+ * tree engine moves its array once per level, so for wide records this cuts
+ * the bytes on the wire to those of the pairs plus one pass of records. */
+
+template <typename K> struct KeyIndex {
+  K key;
+  std::uint32_t rank;  /* rank holding the element */
+  std::uint32_t index; /* position of the element there */
+
+  friend auto operator<=>(const KeyIndex &x, const KeyIndex &y) {
+    return x.key <=> y.key;
+  }
+};
+
+template <typename K> struct RadixKey<KeyIndex<K>> {
+  static auto get(const KeyIndex<K> &v) { return RadixKey<K>::get(v.key); }
+};
+
+/* Pairs for this rank's elements, which must have a key member */
+template <typename T>
+auto extractKeys(const std::vector<T> &a, MPI::Intracomm &comm) {
+  std::vector<KeyIndex<decltype(T::key)>> pairs(a.size());
+  std::uint32_t rank = comm.Get_rank();
+  for (std::uint32_t i = 0; i < a.size(); ++i)
+    pairs[i] = {a[i].key, rank, i};
+  return pairs;
+}
+
+/* Elements the sorted pairs refer to, in the order of the pairs. Requests
+ * are grouped by owner, the owners answer with one Alltoallv and the
+ * answers are put in place locally. */
+template <typename T, typename K>
+std::vector<T> fetchByIndex(const std::vector<T> &a,
+                            const std::vector<KeyIndex<K>> &sorted,
+                            MPI::Intracomm &comm) {
+  auto commSize = comm.Get_size();
+
+  std::vector<int> sendCounts(commSize, 0);
+  for (auto &p : sorted)
+    ++sendCounts[p.rank];
+  auto sendDispls = displacements(sendCounts);
+
+  /* Request j asks for element indices[j], which goes to slot[j] */
+  std::vector<int> indices(sorted.size());
+  std::vector<int> slot(sorted.size());
+  auto next = sendDispls;
+  for (std::size_t i = 0; i < sorted.size(); ++i) {
+    auto j = next[sorted[i].rank]++;
+    indices[j] = sorted[i].index;
+    slot[j] = i;
+  }
+
+  std::vector<int> recvCounts(commSize);
+  comm.Alltoall(sendCounts.data(), 1, MPI::INT, recvCounts.data(), 1,
+                MPI::INT);
+  auto recvDispls = displacements(recvCounts);
+
+  std::vector<int> wanted(recvDispls.back() + recvCounts.back());
+  comm.Alltoallv(indices.data(), sendCounts.data(), sendDispls.data(),
+                 MPI::INT, wanted.data(), recvCounts.data(), recvDispls.data(),
+                 MPI::INT);
+
+  std::vector<T> reply(wanted.size());
+  for (std::size_t i = 0; i < wanted.size(); ++i)
+    reply[i] = a[wanted[i]];
+
+  std::vector<T> answers(sorted.size());
+  auto type = mpiType<T>();
+  comm.Alltoallv(reply.data(), recvCounts.data(), recvDispls.data(), type,
+                 answers.data(), sendCounts.data(), sendDispls.data(), type);
+
+  std::vector<T> result(sorted.size());
+  for (std::size_t j = 0; j < answers.size(); ++j)
+    result[slot[j]] = answers[j];
+  return result;
+}
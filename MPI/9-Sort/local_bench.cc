@@ -0,0 +1,71 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <mpi.h>
+
+#include "local_sort.hh"
+#include "rng.hh"
+
+/* Compare node-local sort kernels against std::sort on the same keys. Key
+ * range defaults to the array size, as in the distributed benchmark. */
+int main(int ac, char **av) {
+  MPI::Init(ac, av);
+
+  if (ac < 2) {
+    std::cerr << "Usage: " << av[0] << " array-size [key-range] [repeat]"
+              << std::endl;
+    MPI::COMM_WORLD.Abort(1);
+  }
+
+  int arrSize = atoi(av[1]);
+  long long range = (ac > 2) ? atoll(av[2]) : arrSize;
+  int repeat = (ac > 3) ? atoi(av[3]) : 3;
+  if (arrSize <= 0 || range <= 0 || repeat <= 0) {
+    std::cerr << "Sizes must be positive" << std::endl;
+    MPI::COMM_WORLD.Abort(1);
+  }
+
+  auto input = generateRange<int>(0, arrSize, range);
+  auto expected = input;
+  std::sort(expected.begin(), expected.end());
+
+  std::cout << "Array size = " << arrSize << ", key range = " << range
+            << std::endl;
+  std::cout << std::left << std::setw(10) << "kernel" << std::right
+            << std::setw(12) << "time, ms" << std::setw(14) << "Mkeys/s"
+            << std::setw(10) << "vs std" << std::endl;
+
+  double stdTime = 0;
+  int res = 0;
+  std::vector<int> a(arrSize);
+  std::vector<int> tmp(arrSize);
+  /* std::sort goes first to be the reference for the others */
+  LocalSort order[] = {LocalSort::Std, LocalSort::Merge, LocalSort::PingPong,
+                       LocalSort::Bitonic, LocalSort::Radix};
+  for (auto kind : order) {
+    double best = 0;
+    for (int r = 0; r < repeat; ++r) {
+      a = input;
+      auto start = MPI::Wtime();
+      localSort(a.begin(), tmp.begin(), arrSize, kind);
+      auto time = MPI::Wtime() - start;
+      best = (r == 0) ? time : std::min(best, time);
+    }
+    if (kind == LocalSort::Std)
+      stdTime = best;
+
+    auto ok = (a == expected);
+    res |= !ok;
+    std::cout << std::left << std::setw(10) << localSortName(kind)
+              << std::right << std::fixed << std::setprecision(2)
+              << std::setw(12) << best * 1e3 << std::setw(14)
+              << arrSize / best / 1e6 << std::setw(10) << stdTime / best
+              << (ok ? "" : "  WRONG") << std::endl;
+  }
+
+  MPI::Finalize();
+  return res;
+}
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <type_traits>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "serial_sort.hh"
+
+/* Node-local sort kernels, selected at run time:
+ *   merge    - recursive merge sort copying every merge back from tmp
+ *   pingpong - insertion-sorted blocks merged bottom-up, alternating between
+ *              a and tmp so that data is copied back at most once
+ *   bitonic  - same merge passes over 16-element blocks sorted by a bitonic
+ *              network, eight blocks at a time in SIMD lanes
+ *   radix    - LSD radix sort, 8 bits per pass, passes with a single digit
+ *              value are skipped
+ *   std      - std::sort, the reference
+ *
+ * Radix sort needs an order-preserving unsigned image of the element
+ * (RadixKey) and the default comparator; other element types and custom
+ * comparators fall back to pingpong. */
+enum class LocalSort { Merge, PingPong, Bitonic, Radix, Std };
+
+constexpr LocalSort ALL_LOCAL_SORTS[] = {LocalSort::Merge, LocalSort::PingPong,
+                                         LocalSort::Bitonic, LocalSort::Radix,
+                                         LocalSort::Std};
+
+inline const char *localSortName(LocalSort kind) {
+  switch (kind) {
+  case LocalSort::Merge:
+    return "merge";
+  case LocalSort::PingPong:
+    return "pingpong";
+  case LocalSort::Bitonic:
+    return "bitonic";
+  case LocalSort::Radix:
+    return "radix";
+  case LocalSort::Std:
+    return "std";
+  }
+  return "unknown";
+}
+
+inline bool parseLocalSort(std::string_view name, LocalSort &kind) {
+  for (auto k : ALL_LOCAL_SORTS)
+    if (name == localSortName(k)) {
+      kind = k;
+      return true;
+    }
+  return false;
+}
+
+/* Unsigned value ordered like T under operator<; specialized for every
+ * radix-sortable element type */
+template <typename T, typename = void> struct RadixKey;
+
+template <typename T>
+struct RadixKey<T, std::enable_if_t<std::is_integral_v<T>>> {
+  using U = std::make_unsigned_t<T>;
+  static U get(T v) {
+    constexpr U flip = std::is_signed_v<T> ? U{1} << (8 * sizeof(T) - 1) : 0;
+    return static_cast<U>(v) ^ flip;
+  }
+};
+
+/* IEEE doubles: negative values have all bits flipped, positive values only
+ * the sign bit */
+template <> struct RadixKey<double> {
+  using U = std::uint64_t;
+  static U get(double v) {
+    auto bits = std::bit_cast<U>(v);
+    return (bits >> 63) ? ~bits : bits ^ (U{1} << 63);
+  }
+};
+
+template <typename T, typename Cmp>
+constexpr bool radixSortable =
+    std::is_same_v<Cmp, std::less<>> && requires(T v) { RadixKey<T>::get(v); };
+
+/* Bottom-up merge of sorted runs of the given width until one is left */
+template <typename It, typename Cmp>
+void mergePasses(It a, It tmp, int size, int width, Cmp cmp) {
+  auto src = a;
+  auto dst = tmp;
+  for (; width < size; width *= 2) {
+    for (int lo = 0; lo < size; lo += 2 * width) {
+      auto mid = std::min(lo + width, size);
+      auto hi = std::min(lo + 2 * width, size);
+      std::merge(src + lo, src + mid, src + mid, src + hi, dst + lo, cmp);
+    }
+    std::swap(src, dst);
+  }
+  if (src != a)
+    std::copy_n(src, size, a);
+}
+
+template <typename It, typename Cmp>
+void mergeSortPingPong(It a, It tmp, int size, Cmp cmp) {
+  for (int lo = 0; lo < size; lo += SMALL)
+    insertionSort(a + lo, std::min(SMALL, size - lo), cmp);
+  mergePasses(a, tmp, size, SMALL, cmp);
+}
+
+constexpr int NET = 16;  /* elements sorted by one network */
+constexpr int LANES = 8; /* networks run side by side */
+
+/* Element e of block l lives in lane l of row e */
+template <typename T> struct Row {
+  alignas(32) T v[LANES];
+};
+
+template <typename T, typename Cmp>
+void compareExchange(Row<T> &lo, Row<T> &hi, Cmp cmp) {
+  for (int l = 0; l < LANES; ++l) {
+    auto x = lo.v[l];
+    auto y = hi.v[l];
+    auto swap = cmp(y, x);
+    lo.v[l] = swap ? y : x;
+    hi.v[l] = swap ? x : y;
+  }
+}
+
+#ifdef __AVX2__
+inline void compareExchange(Row<int> &lo, Row<int> &hi, std::less<>) {
+  auto x = _mm256_load_si256(reinterpret_cast<const __m256i *>(lo.v));
+  auto y = _mm256_load_si256(reinterpret_cast<const __m256i *>(hi.v));
+  _mm256_store_si256(reinterpret_cast<__m256i *>(lo.v), _mm256_min_epi32(x, y));
+  _mm256_store_si256(reinterpret_cast<__m256i *>(hi.v), _mm256_max_epi32(x, y));
+}
+#endif
+
+/* Bitonic sorting network for NET rows, all lanes at once */
+template <typename T, typename Cmp> void bitonicNetwork(Row<T> *rows, Cmp cmp) {
+  for (int k = 2; k <= NET; k *= 2)
+    for (int j = k / 2; j > 0; j /= 2)
+      for (int i = 0; i < NET; ++i) {
+        auto l = i ^ j;
+        if (l <= i)
+          continue;
+        if ((i & k) == 0)
+          compareExchange(rows[i], rows[l], cmp);
+        else
+          compareExchange(rows[l], rows[i], cmp);
+      }
+}
+
+/* Sort every NET-element block of a[0, size) */
+template <typename It, typename Cmp>
+void sortBlocksBitonic(It a, int size, Cmp cmp) {
+  using T = std::remove_cvref_t<decltype(*a)>;
+  Row<T> rows[NET];
+  int lo = 0;
+  for (; lo + NET * LANES <= size; lo += NET * LANES) {
+    for (int e = 0; e < NET; ++e)
+      for (int l = 0; l < LANES; ++l)
+        rows[e].v[l] = a[lo + l * NET + e];
+    bitonicNetwork(rows, cmp);
+    for (int e = 0; e < NET; ++e)
+      for (int l = 0; l < LANES; ++l)
+        a[lo + l * NET + e] = rows[e].v[l];
+  }
+  for (; lo < size; lo += NET)
+    insertionSort(a + lo, std::min(NET, size - lo), cmp);
+}
+
+template <typename It, typename Cmp>
+void mergeSortBitonic(It a, It tmp, int size, Cmp cmp) {
+  sortBlocksBitonic(a, size, cmp);
+  mergePasses(a, tmp, size, NET, cmp);
+}
+
+/* LSD radix sort on RadixKey images of the elements */
+template <typename It> void radixSort(It a, It tmp, int size) {
+  using T = std::remove_cvref_t<decltype(*a)>;
+  using Key = RadixKey<T>;
+  constexpr int BITS = 8;
+  constexpr int PASSES = 8 * sizeof(Key::get(*a)) / BITS;
+  constexpr int BUCKETS = 1 << BITS;
+
+  auto digit = [](const T &v, int pass) {
+    return static_cast<int>((Key::get(v) >> (pass * BITS)) & (BUCKETS - 1));
+  };
+
+  /* All histograms in a single read of the input */
+  static thread_local int count[PASSES][BUCKETS];
+  std::fill(&count[0][0], &count[0][0] + PASSES * BUCKETS, 0);
+  for (int i = 0; i < size; ++i)
+    for (int p = 0; p < PASSES; ++p)
+      ++count[p][digit(a[i], p)];
+
+  auto src = a;
+  auto dst = tmp;
+  for (int p = 0; p < PASSES; ++p) {
+    /* Every key has the same digit: the pass would not move anything */
+    if (size == 0 || count[p][digit(src[0], p)] == size)
+      continue;
+
+    int offset = 0;
+    for (int b = 0; b < BUCKETS; ++b) {
+      auto c = count[p][b];
+      count[p][b] = offset;
+      offset += c;
+    }
+    for (int i = 0; i < size; ++i)
+      dst[count[p][digit(src[i], p)]++] = src[i];
+    std::swap(src, dst);
+  }
+  if (src != a)
+    std::copy_n(src, size, a);
+}
+
+/* Sort a[0, size) with tmp[0, size) as scratch space */
+template <typename It, typename Cmp = std::less<>>
+void localSort(It a, It tmp, int size, LocalSort kind, Cmp cmp = {}) {
+  using T = std::remove_cvref_t<decltype(*a)>;
+  switch (kind) {
+  case LocalSort::Merge:
+    mergeSortSerial(a, tmp, size, cmp);
+    break;
+  case LocalSort::PingPong:
+    mergeSortPingPong(a, tmp, size, cmp);
+    break;
+  case LocalSort::Bitonic:
+    mergeSortBitonic(a, tmp, size, cmp);
+    break;
+  case LocalSort::Radix:
+    if constexpr (radixSortable<T, Cmp>)
+      radixSort(a, tmp, size);
+    else
+      mergeSortPingPong(a, tmp, size, cmp);
+    break;
+  case LocalSort::Std:
+    std::sort(a, a + size, cmp);
+    break;
+  }
+}
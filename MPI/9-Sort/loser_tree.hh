@@ -0,0 +1,188 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "parallel_sort.hh"
+#include "thread_pool.hh"
+
+/* How sorted runs from different ranks are combined:
+ *   pairwise - merged two at a time, one pass over the data per level
+ *   kway     - merged in a single pass by a loser tree once all have arrived
+ *   stream   - merged by a loser tree while they are still arriving, with a
+ *              bounded buffer per source */
+enum class MergeKind { Pairwise, KWay, Stream };
+
+constexpr MergeKind ALL_MERGE_KINDS[] = {MergeKind::Pairwise, MergeKind::KWay,
+                                         MergeKind::Stream};
+
+inline const char *mergeKindName(MergeKind kind) {
+  switch (kind) {
+  case MergeKind::Pairwise:
+    return "pairwise";
+  case MergeKind::KWay:
+    return "kway";
+  case MergeKind::Stream:
+    return "stream";
+  }
+  return "unknown";
+}
+
+inline bool parseMergeKind(std::string_view name, MergeKind &kind) {
+  for (auto k : ALL_MERGE_KINDS)
+    if (name == mergeKindName(k)) {
+      kind = k;
+      return true;
+    }
+  return false;
+}
+
+/* A source is a sorted sequence read front to back through empty(), front()
+ * and pop(). front() and empty() never block; a source whose data is still
+ * in flight waits for it in pop() or on construction. */
+
+/* Sorted run [cur, end) already in memory */
+template <typename It> struct RunSource {
+  It cur;
+  It end;
+
+  bool empty() const { return cur == end; }
+  decltype(auto) front() const { return *cur; }
+  void pop() { ++cur; }
+};
+
+/* Tournament tree over k sources: leaf i is source i, internal node n holds
+ * the loser of the match between the winners of its subtrees 2n and 2n + 1,
+ * and the overall winner is kept aside. Taking the smallest element replays
+ * only the matches on the path from its leaf to the root, log2 k
+ * comparisons. Ties go to the lower source, so the merge is stable. */
+template <typename Src, typename Cmp> class LoserTree {
+public:
+  LoserTree(std::vector<Src> &sources, Cmp cmp)
+      : sources_(sources), cmp_(cmp), k_(sources.size()), loser_(k_) {
+    if (k_ == 0)
+      return;
+    std::vector<int> winner(2 * k_);
+    for (int i = 0; i < k_; ++i)
+      winner[k_ + i] = i;
+    for (int n = k_ - 1; n > 0; --n) {
+      auto x = winner[2 * n];
+      auto y = winner[2 * n + 1];
+      winner[n] = beats(x, y) ? x : y;
+      loser_[n] = beats(x, y) ? y : x;
+    }
+    winner_ = (k_ == 1) ? 0 : winner[1];
+  }
+
+  bool empty() const { return k_ == 0 || sources_[winner_].empty(); }
+  decltype(auto) front() const { return sources_[winner_].front(); }
+
+  void pop() {
+    auto w = winner_;
+    sources_[w].pop();
+    for (auto n = (k_ + w) / 2; n > 0; n /= 2)
+      if (beats(loser_[n], w))
+        std::swap(loser_[n], w);
+    winner_ = w;
+  }
+
+private:
+  /* Source i goes before source j; exhausted sources lose every match */
+  bool beats(int i, int j) const {
+    if (sources_[i].empty())
+      return false;
+    if (sources_[j].empty())
+      return true;
+    auto &x = sources_[i].front();
+    auto &y = sources_[j].front();
+    return cmp_(x, y) || (!cmp_(y, x) && i < j);
+  }
+
+  std::vector<Src> &sources_;
+  Cmp cmp_;
+  int k_;
+  std::vector<int> loser_;
+  int winner_ = 0;
+};
+
+/* Merge all sources into out. Every time another step elements are final,
+ * and once at the end, emit(count of final elements) is called. Returns
+ * the number of elements merged. */
+template <typename Src, typename Out, typename Cmp, typename Emit>
+long long mergeSources(std::vector<Src> &sources, Out out, Cmp cmp,
+                       long long step, Emit emit) {
+  LoserTree<Src, Cmp> tree{sources, cmp};
+  long long done = 0;
+  for (auto nextEmit = step; !tree.empty(); tree.pop()) {
+    out[done++] = tree.front();
+    if (done == nextEmit) {
+      emit(done);
+      nextEmit += step;
+    }
+  }
+  emit(done);
+  return done;
+}
+
+template <typename Src, typename Out, typename Cmp>
+long long mergeSources(std::vector<Src> &sources, Out out, Cmp cmp) {
+  return mergeSources(sources, out, cmp, -1, [](long long) {});
+}
+
+/* K-way counterpart of mergeRunsParallel: merge the sorted runs
+ * a[runStart[r], runStart[r + 1]) into out at the same positions in one
+ * pass. With more than one thread the key range is cut at values picked
+ * from regular samples of all runs, every run is split at the same values
+ * by binary search and each slice of the output is merged by its own task;
+ * many equal keys can leave the slices unbalanced. */
+template <typename It, typename Cmp = std::less<>>
+void mergeRunsKWay(It a, It out, const std::vector<int> &runStart,
+                   ThreadPool &pool, Cmp cmp = {}) {
+  int numRuns = runStart.size() - 1;
+  auto total = runStart.back() - runStart.front();
+  int parts = (total < PARALLEL_GRAIN) ? 1 : pool.size();
+
+  /* cut[p][r]: where slice p starts in run r */
+  std::vector<std::vector<int>> cut(parts + 1);
+  cut[0].assign(runStart.begin(), runStart.end() - 1);
+  cut[parts].assign(runStart.begin() + 1, runStart.end());
+  if (parts > 1) {
+    constexpr int OVERSAMPLE = 8;
+    using T = std::remove_cvref_t<decltype(*a)>;
+    std::vector<T> samples{};
+    for (int r = 0; r < numRuns; ++r) {
+      auto len = runStart[r + 1] - runStart[r];
+      if (len == 0)
+        continue;
+      auto count = std::max(1, static_cast<int>(static_cast<long long>(parts) *
+                                                OVERSAMPLE * len / total));
+      for (int s = 0; s < count; ++s)
+        samples.push_back(
+            a[runStart[r] + static_cast<long long>(s) * len / count]);
+    }
+    std::sort(samples.begin(), samples.end(), cmp);
+    for (int p = 1; p < parts; ++p) {
+      auto pivot = samples[samples.size() * p / parts];
+      for (int r = 0; r < numRuns; ++r)
+        cut[p].push_back(std::lower_bound(a + runStart[r],
+                                          a + runStart[r + 1], pivot, cmp) -
+                         a);
+    }
+  }
+
+  TaskGroup group{};
+  for (int p = 0; p < parts; ++p) {
+    auto dest = runStart.front();
+    for (int r = 0; r < numRuns; ++r)
+      dest += cut[p][r] - runStart[r];
+    std::vector<RunSource<It>> sources{};
+    for (int r = 0; r < numRuns; ++r)
+      sources.push_back({a + cut[p][r], a + cut[p + 1][r]});
+    pool.submit(group,
+                [=]() mutable { mergeSources(sources, out + dest, cmp); });
+  }
+  pool.wait(group);
+}
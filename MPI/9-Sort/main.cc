@@ -1,193 +1,312 @@
 #include <algorithm>
-#include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string_view>
 #include <vector>
 
 #include <mpi.h>
 
-using Vec = std::vector<int>;
-using VIter = Vec::iterator;
-
-constexpr int SMALL = 32;
-
-int topmostLevel(int rank);
-void insertionSort(VIter a, int size);
-
-void runHelperMPI(int rank, int maxRank, int tag, MPI::Comm &comm);
-void runRootMPI(Vec &a, Vec &tmp, int maxRank, int tag, MPI::Comm &comm);
-
-void merge(VIter a, VIter tmp, int size);
-void mergeSortSerial(VIter a, VIter tmp, int size);
-void mergeSortParallel(Vec &a, Vec &tmp, int size, int level, int rank,
-                       int maxRank, int tag, MPI::Comm &comm);
+#include "dist_io.hh"
+#include "external_sort.hh"
+#include "key_index.hh"
+#include "local_sort.hh"
+#include "loser_tree.hh"
+#include "mpi_type.hh"
+#include "records.hh"
+#include "rng.hh"
+#include "sample_sort.hh"
+#include "serial_sort.hh"
+#include "thread_pool.hh"
+#include "tree_sort.hh"
+#include "verify.hh"
+
+enum class Algo { Tree, Sample };
+enum class Gen { Root, Dist };
+enum class Type { Int, Long, Double, Name, Record };
+
+struct Options {
+  long long arrSize = -1;
+  Algo algo = Algo::Sample;
+  /* Root: rank 0 generates the whole array and scatters it;
+   * Dist: every rank generates its own block */
+  Gen gen = Gen::Root;
+  LocalSort local = LocalSort::Radix;
+  MergeKind merge = MergeKind::KWay; /* how runs from other ranks combine */
+  int threads = 1; /* sorting threads per rank */
+  const char *out = nullptr; /* file for the sorted array */
+  Type type = Type::Int;
+  Dist dist = Dist::Uniform; /* shape of the generated keys */
+  bool descending = false; /* sort with std::greater<> */
+  bool byKey = false;      /* sort (key, index) pairs, move records once */
+  long long memMB = 0; /* external sort within this budget per rank */
+  const char *scratch = "."; /* directory for its scratch files */
+};
+
+bool parseOptions(int ac, char **av, Options &opts);
+bool parseType(std::string_view name, Type &type);
+void usage(const char *name);
+template <typename T, typename Cmp>
+int sortAndCheck(const Options &opts, Cmp cmp, MPI::Intracomm &comm);
+template <typename T, typename Cmp>
+int sortExternal(const Options &opts, Cmp cmp, MPI::Intracomm &comm);
+template <typename T, typename Cmp>
+void sortElements(std::vector<T> &a, const Options &opts, Cmp cmp,
+                  ThreadPool &pool, MPI::Intracomm &comm);
+template <typename T, typename Cmp>
+void runEngine(std::vector<T> &a, const Options &opts, Cmp cmp,
+               ThreadPool &pool, MPI::Intracomm &comm);
+
+/* One instantiation of the whole program per element type and order */
+template <typename T>
+int sortAs(const Options &opts, MPI::Intracomm &comm) {
+  if (opts.descending)
+    return sortAndCheck<T>(opts, std::greater<>{}, comm);
+  return sortAndCheck<T>(opts, std::less<>{}, comm);
+}
 
 int main(int ac, char **av) {
-  MPI::Init(ac, av);
+  /* Worker threads only sort, MPI calls stay on the main thread */
+  auto provided = MPI::Init_thread(ac, av, MPI::THREAD_FUNNELED);
 
-  auto commsize = MPI::COMM_WORLD.Get_size();
-  auto rank = MPI::COMM_WORLD.Get_rank();
+  auto &comm = MPI::COMM_WORLD;
+  auto commSize = comm.Get_size();
+  auto rank = comm.Get_rank();
 
-  auto maxRank = commsize - 1;
-  int tag = 123;
+  Options opts{};
+  if (!parseOptions(ac, av, opts)) {
+    if (rank == 0)
+      usage(av[0]);
+    comm.Abort(1);
+  }
 
-  /* Only root process sets test data */
-  if (rank != 0) {
-    runHelperMPI(rank, maxRank, tag, MPI::COMM_WORLD);
-    MPI::Finalize();
-    return 0;
+  /* Without FUNNELED, no other thread may even exist: sort on this one */
+  if (provided < MPI::THREAD_FUNNELED && opts.threads > 1) {
+    if (rank == 0)
+      std::cerr << "MPI without MPI_THREAD_FUNNELED, using --threads 1"
+                << std::endl;
+    opts.threads = 1;
   }
 
-  if (ac != 2) {
-    std::cerr << "Usage: " << av[0] << " array-size" << std::endl;
-    MPI::COMM_WORLD.Abort(1);
+  if (rank == 0) {
+    std::cout << "Array size = " << opts.arrSize << std::endl;
+    std::cout << "Processes = " << commSize << std::endl;
   }
 
-  auto arrSize = atoi(av[1]); /* Array size */
+  int res = 0;
+  switch (opts.type) {
+  case Type::Int:
+    res = sortAs<int>(opts, comm);
+    break;
+  case Type::Long:
+    res = sortAs<long long>(opts, comm);
+    break;
+  case Type::Double:
+    res = sortAs<double>(opts, comm);
+    break;
+  case Type::Name:
+    res = sortAs<Name>(opts, comm);
+    break;
+  case Type::Record:
+    res = sortAs<Record>(opts, comm);
+    break;
+  }
+  if (res != 0)
+    comm.Abort(res);
 
-  std::cout << "Array size = " << arrSize << std::endl;
-  std::cout << "Processes = " << commsize << std::endl;
+  MPI::Finalize();
+  return 0;
+}
 
-  Vec a{};
-  a.resize(arrSize);
-  auto tmp{a};
+template <typename T, typename Cmp>
+int sortAndCheck(const Options &opts, Cmp cmp, MPI::Intracomm &comm) {
+  auto rank = comm.Get_rank();
+  if (opts.memMB > 0)
+    return sortExternal<T>(opts, cmp, comm);
+
+  /* The tree engine starts from the whole array on rank 0 */
+  std::vector<T> a{};
+  if (opts.algo == Algo::Tree) {
+    if (rank == 0)
+      a = generateRange<T>(0, opts.arrSize, opts.arrSize, opts.dist);
+  } else if (opts.gen == Gen::Root) {
+    std::vector<T> all{};
+    if (rank == 0)
+      all = generateRange<T>(0, opts.arrSize, opts.arrSize, opts.dist);
+    a = distribute(all, opts.arrSize, comm);
+  } else {
+    a = generateBlock<T>(opts.arrSize, comm, opts.dist);
+  }
 
-  /* Random array initialization */
-  srand(314159);
-  std::generate(a.begin(), a.end(), [arrSize] { return rand() % arrSize; });
+  auto sumBefore = checksum(a, comm);
+  ThreadPool pool{opts.threads};
 
-  /* Sort with root process */
+  comm.Barrier();
   auto start = MPI::Wtime();
-  runRootMPI(a, tmp, maxRank, tag, MPI::COMM_WORLD);
+  sortElements(a, opts, cmp, pool, comm);
+  comm.Barrier();
   auto end = MPI::Wtime();
 
-  std::cout << "Elapsed = " << (end - start) << std::endl;
+  if (rank == 0)
+    std::cout << "Elapsed = " << (end - start) << std::endl;
 
   /* Result check */
-  if (!std::is_sorted(a.begin(), a.end())) {
-    MPI::COMM_WORLD.Abort(1);
+  if (!isSortedDistributed(a, opts.arrSize, cmp, comm) ||
+      checksum(a, comm) != sumBefore)
+    return 1;
+
+  if (opts.out && !writeDistributed(a, opts.out, comm)) {
+    if (rank == 0)
+      std::cerr << "Failed to write " << opts.out << std::endl;
+    return 1;
   }
-
-  MPI::Finalize();
   return 0;
 }
 
-/* Root process code */
-void runRootMPI(Vec &a, Vec &tmp, int maxRank, int tag, MPI::Comm &comm) {
-  auto rank = comm.Get_rank();
-  if (rank != 0) {
-    std::cerr << "Error: run_root_mpi called from process " << rank
-              << "; must be called from process 0 only" << std::endl;
-    MPI::COMM_WORLD.Abort(1);
+bool parseOptions(int ac, char **av, Options &opts) {
+  if (ac < 2)
+    return false;
+
+  opts.arrSize = atoll(av[1]); /* Array size */
+  for (int i = 2; i < ac; ++i) {
+    std::string_view arg = av[i];
+    if (arg == "--by-key") {
+      opts.byKey = true;
+      continue;
+    }
+    if (i + 1 == ac)
+      return false;
+    std::string_view val = av[++i];
+    if (arg == "--algo" && (val == "tree" || val == "sample"))
+      opts.algo = (val == "tree") ? Algo::Tree : Algo::Sample;
+    else if (arg == "--gen" && (val == "root" || val == "dist"))
+      opts.gen = (val == "root") ? Gen::Root : Gen::Dist;
+    else if (arg == "--local" && parseLocalSort(val, opts.local))
+      continue;
+    else if (arg == "--merge" && parseMergeKind(val, opts.merge))
+      continue;
+    else if (arg == "--threads")
+      opts.threads = atoi(av[i]);
+    else if (arg == "--out")
+      opts.out = av[i];
+    else if (arg == "--type" && parseType(val, opts.type))
+      continue;
+    else if (arg == "--dist" && parseDist(val, opts.dist))
+      continue;
+    else if (arg == "--order" && (val == "asc" || val == "desc"))
+      opts.descending = (val == "desc");
+    else if (arg == "--mem")
+      opts.memMB = atoll(av[i]);
+    else if (arg == "--scratch")
+      opts.scratch = av[i];
+    else
+      return false;
   }
 
-  mergeSortParallel(a, tmp, a.size(), 0, rank, maxRank, tag, comm);
-  /* level=0; rank=root_rank=0; */
-  return;
+  /* Only records have a key apart from the element itself */
+  if (opts.byKey && opts.type != Type::Record)
+    return false;
+
+  /* The external sort is a sample sort of locally generated blocks and
+   * never holds a block in memory */
+  if (opts.memMB > 0)
+    return opts.arrSize > 0 && opts.algo == Algo::Sample && !opts.byKey &&
+           opts.threads > 0;
+
+  /* Only the distributed engine can sort more than fits one rank */
+  auto perRank = (opts.gen == Gen::Dist && opts.algo == Algo::Sample)
+                     ? opts.arrSize / MPI::COMM_WORLD.Get_size()
+                     : opts.arrSize;
+  return opts.arrSize > 0 && perRank < INT32_MAX && opts.threads > 0;
 }
 
-/* Helper process code */
-void runHelperMPI(int rank, int maxRank, int tag, MPI::Comm &comm) {
-  auto level = topmostLevel(rank);
-  /* probe for a message and determine its size and sender */
-  MPI::Status status{};
-  comm.Probe(MPI::ANY_SOURCE, tag, status);
-  auto size = status.Get_count(MPI::INT);
-  auto parentRank = status.Get_source();
-
-  Vec a{};
-  a.resize(size);
-  Vec tmp = a;
-
-  comm.Recv(a.data(), size, MPI::INT, parentRank, tag);
-  mergeSortParallel(a, tmp, size, level, rank, maxRank, tag, comm);
-  /* Send sorted array to parent process */
-  comm.Send(a.data(), size, MPI::INT, parentRank, tag);
-  return;
+bool parseType(std::string_view name, Type &type) {
+  constexpr std::pair<const char *, Type> names[] = {
+      {"int", Type::Int},
+      {"long", Type::Long},
+      {"double", Type::Double},
+      {"string", Type::Name},
+      {"record", Type::Record}};
+  for (auto [n, t] : names)
+    if (name == n) {
+      type = t;
+      return true;
+    }
+  return false;
 }
 
-/* Given a process rank, calculate the top level of the process tree in which */
-/* the process participates Root assumed to always have rank 0 and to */
-/* participate at level 0 of the process tree */
-int topmostLevel(int rank) {
-  int level = 0;
-  while (pow(2, level) <= rank)
-    ++level;
-  return level;
+void usage(const char *name) {
+  std::cerr << "Usage: " << name
+            << " array-size [--algo sample|tree] [--gen root|dist]"
+               " [--local merge|pingpong|bitonic|radix|std]"
+               " [--merge pairwise|kway|stream] [--threads N]"
+               " [--out file] [--type int|long|double|string|record]"
+               " [--order asc|desc] [--by-key] [--mem MiB [--scratch dir]]"
+               " [--dist uniform|zipf|sorted|reverse|dups|nearly]"
+            << std::endl;
 }
 
-/* MPI merge sort */
-void mergeSortParallel(Vec &a, Vec &tmp, int size, int level, int rank,
-                       int maxRank, int tag, MPI::Comm &comm) {
-  auto helperRank = rank + static_cast<int>(pow(2, level));
-  if (helperRank > maxRank) { /* no more processes available */
-    mergeSortSerial(a.begin(), tmp.begin(), size);
-    return;
+/* Sort with the selected engine; with --by-key, records are sorted through
+ * their (key, index) pairs */
+template <typename T, typename Cmp>
+void sortElements(std::vector<T> &a, const Options &opts, Cmp cmp,
+                  ThreadPool &pool, MPI::Intracomm &comm) {
+  if constexpr (requires { T::key; }) {
+    if (opts.byKey) {
+      auto pairs = extractKeys(a, comm);
+      runEngine(pairs, opts, cmp, pool, comm);
+      a = fetchByIndex(a, pairs, comm);
+      return;
+    }
   }
+  runEngine(a, opts, cmp, pool, comm);
+}
 
-  /* Send second half, asynchronous */
-  auto request = comm.Isend(a.data() + size / 2, size - size / 2, MPI::INT,
-                            helperRank, tag);
-  /* Sort first half */
-  mergeSortParallel(a, tmp, size / 2, level + 1, rank, maxRank, tag, comm);
-  /* Free the async request (matching receive will complete the transfer). */
-  request.Free();
+template <typename T, typename Cmp>
+void runEngine(std::vector<T> &a, const Options &opts, Cmp cmp,
+               ThreadPool &pool, MPI::Intracomm &comm) {
+  if (opts.algo == Algo::Tree)
+    treeSort(a, opts.local, opts.merge, pool, comm, cmp);
+  else
+    sampleSort(a, opts.local, opts.merge, pool, comm, cmp);
+}
 
-  /* Receive second half sorted */
-  comm.Recv(a.data() + size / 2, size - size / 2, MPI::INT, helperRank, tag);
+/* Out-of-core sort within --mem MiB per rank; the result is checked as it
+ * is merged, since it never is in memory as a whole */
+template <typename T, typename Cmp>
+int sortExternal(const Options &opts, Cmp cmp, MPI::Intracomm &comm) {
+  ExternalConfig cfg{opts.memMB << 20, opts.scratch, opts.dist};
+  ThreadPool pool{opts.threads};
 
-  /* Merge the two sorted sub-arrays through tmp */
-  merge(a.begin(), tmp.begin(), size);
-}
+  comm.Barrier();
+  auto start = MPI::Wtime();
+  auto res = externalSort<T>(opts.arrSize, cfg, opts.local, opts.out, pool,
+                             comm, cmp);
+  comm.Barrier();
+  auto end = MPI::Wtime();
 
-void mergeSortSerial(VIter a, VIter tmp, int size) {
-  /* Switch to insertion sort for small arrays */
-  if (size <= SMALL) {
-    insertionSort(a, size);
-    return;
+  if (!res.ok) {
+    if (!res.failed.empty())
+      std::cerr << "Failed to access " << res.failed << std::endl;
+    return 1;
   }
-  mergeSortSerial(a, tmp, size / 2);
-  mergeSortSerial(a + size / 2, tmp, size - size / 2);
-  /* Merge the two sorted subarrays into a tmp array */
-  merge(a, tmp, size);
-}
 
-void merge(VIter a, VIter tmp, int size) {
-  int i1 = 0;
-  int i2 = size / 2;
-  int tmpi = 0;
-  while (i1 < size / 2 && i2 < size) {
-    if (a[i1] < a[i2]) {
-      tmp[tmpi] = a[i1];
-      ++i1;
-    } else {
-      tmp[tmpi] = a[i2];
-      ++i2;
-    }
-    ++tmpi;
-  }
-  while (i1 < size / 2) {
-    tmp[tmpi] = a[i1];
-    ++i1;
-    ++tmpi;
-  }
-  while (i2 < size) {
-    tmp[tmpi] = a[i2];
-    ++i2;
-    ++tmpi;
+  if (comm.Get_rank() == 0) {
+    std::cout << "Runs on rank 0 = " << res.runs << std::endl;
+    std::cout << "Run formation = " << res.runTime << std::endl;
+    std::cout << "Exchange = " << res.exchangeTime << std::endl;
+    std::cout << "Final merge = " << res.mergeTime << std::endl;
+    std::cout << "Elapsed = " << (end - start) << std::endl;
   }
-  /* Copy sorted tmp array into main array, a */
-  std::copy_n(tmp, size, a);
-}
 
-void insertionSort(VIter a, int size) {
-  for (int i = 0; i < size; ++i) {
-    int j;
-    auto v = a[i];
-    for (j = i - 1; j >= 0; j--) {
-      if (a[j] <= v)
-        break;
-      a[j + 1] = a[j];
-    }
-    a[j + 1] = v;
-  }
+  unsigned long long sums[2] = {res.inputSum, res.outputSum};
+  unsigned long long totals[2] = {0, 0};
+  comm.Allreduce(sums, totals, 2, MPI::UNSIGNED_LONG_LONG, MPI::SUM);
+  if (!isOrderedDistributed(res.sorted, res.count, res.first, res.last,
+                            opts.arrSize, cmp, comm) ||
+      totals[0] != totals[1])
+    return 1;
+  return 0;
 }
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <type_traits>
+
+#include <mpi.h>
+
+/* MPI datatype of an element type: the builtin type for arithmetic types,
+ * otherwise a contiguous block of sizeof(T) bytes, created and committed on
+ * first use. Elements travel as raw bytes, so only trivially copyable types
+ * are allowed and all ranks must share one ABI. */
+template <typename T> MPI::Datatype mpiType() {
+  if constexpr (std::is_same_v<T, int>)
+    return MPI::INT;
+  else if constexpr (std::is_same_v<T, unsigned>)
+    return MPI::UNSIGNED;
+  else if constexpr (std::is_same_v<T, long>)
+    return MPI::LONG;
+  else if constexpr (std::is_same_v<T, long long>)
+    return MPI::LONG_LONG;
+  else if constexpr (std::is_same_v<T, unsigned long long>)
+    return MPI::UNSIGNED_LONG_LONG;
+  else if constexpr (std::is_same_v<T, float>)
+    return MPI::FLOAT;
+  else if constexpr (std::is_same_v<T, double>)
+    return MPI::DOUBLE;
+  else {
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "elements are sent as bytes and must be trivially copyable");
+    static auto type = [] {
+      auto t = MPI::BYTE.Create_contiguous(sizeof(T));
+      t.Commit();
+      return t;
+    }();
+    return type;
+  }
+}
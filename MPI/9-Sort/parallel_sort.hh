@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "local_sort.hh"
+#include "serial_sort.hh"
+#include "thread_pool.hh"
+
+/* Multi-threaded node-local sort: blocks are sorted by the selected kernel
+ * as pool tasks and merged pairwise, every merge split between threads
+ * along its merge path so that the last merges are parallel too. */
+
+/* Below this size a sort or merge is not split between threads */
+constexpr int PARALLEL_GRAIN = 1 << 14;
+
+/* Co-rank of output position k when merging sorted a[0, m) and b[0, n):
+ * the first k outputs are a[0, i) and b[0, k - i), ties taken from a, as
+ * std::merge does */
+template <typename It, typename Cmp>
+int coRank(int k, It a, int m, It b, int n, Cmp cmp) {
+  auto lo = std::max(0, k - n);
+  auto hi = std::min(k, m);
+  while (lo < hi) {
+    auto i = lo + (hi - lo) / 2;
+    if (cmp(b[k - i - 1], a[i]))
+      hi = i;
+    else
+      lo = i + 1;
+  }
+  return lo;
+}
+
+/* Merge a[0, m) and b[0, n) into out as parts independent tasks */
+template <typename It, typename Cmp>
+void submitMerge(It a, int m, It b, int n, It out, int parts, Cmp cmp,
+                 ThreadPool &pool, TaskGroup &group) {
+  long long total = m + n;
+  for (int p = 0; p < parts; ++p) {
+    int k0 = total * p / parts;
+    int k1 = total * (p + 1) / parts;
+    pool.submit(group, [=] {
+      auto i0 = coRank(k0, a, m, b, n, cmp);
+      auto i1 = coRank(k1, a, m, b, n, cmp);
+      std::merge(a + i0, a + i1, b + (k0 - i0), b + (k1 - i1), out + k0,
+                 cmp);
+    });
+  }
+}
+
+/* Parallel counterpart of mergeRuns: every pass merges all pairs of runs at
+ * once, each pair split into a share of the threads proportional to its
+ * size */
+template <typename It, typename Cmp = std::less<>>
+void mergeRunsParallel(It a, It tmp, std::vector<int> runStart,
+                       ThreadPool &pool, Cmp cmp = {}) {
+  auto total = runStart.back() - runStart.front();
+  if (pool.size() == 1 || total < PARALLEL_GRAIN) {
+    mergeRuns(a, tmp, runStart, cmp);
+    return;
+  }
+
+  auto src = a;
+  auto dst = tmp;
+  while (runStart.size() > 2) {
+    TaskGroup group{};
+    std::vector<int> merged{runStart[0]};
+    std::size_t i = 0;
+    for (; i + 2 < runStart.size(); i += 2) {
+      auto lo = runStart[i];
+      auto mid = runStart[i + 1];
+      auto hi = runStart[i + 2];
+      auto parts = std::max(
+          1, static_cast<int>(static_cast<long long>(pool.size()) *
+                              (hi - lo) / total));
+      submitMerge(src + lo, mid - lo, src + mid, hi - mid, dst + lo, parts,
+                  cmp, pool, group);
+      merged.push_back(hi);
+    }
+    if (i + 1 < runStart.size()) { /* odd run out */
+      auto lo = runStart[i];
+      auto hi = runStart[i + 1];
+      pool.submit(group, [=] { std::copy(src + lo, src + hi, dst + lo); });
+      merged.push_back(hi);
+    }
+    pool.wait(group);
+    std::swap(src, dst);
+    runStart.swap(merged);
+  }
+
+  if (src != a) {
+    TaskGroup group{};
+    auto lo = runStart.front();
+    auto hi = runStart.back();
+    auto step = (hi - lo + pool.size() - 1) / pool.size();
+    for (auto from = lo; from < hi; from += step) {
+      auto to = std::min(hi, from + step);
+      pool.submit(group, [=] { std::copy(src + from, src + to, a + from); });
+    }
+    pool.wait(group);
+  }
+}
+
+/* Sort a[0, size) with tmp[0, size) as scratch using all pool threads */
+template <typename It, typename Cmp = std::less<>>
+void parallelSort(It a, It tmp, int size, LocalSort kind, ThreadPool &pool,
+                  Cmp cmp = {}) {
+  int numBlocks = std::min(pool.size(), size / PARALLEL_GRAIN);
+  if (numBlocks <= 1) {
+    localSort(a, tmp, size, kind, cmp);
+    return;
+  }
+
+  std::vector<int> runStart(numBlocks + 1);
+  for (int b = 0; b <= numBlocks; ++b)
+    runStart[b] = static_cast<long long>(size) * b / numBlocks;
+
+  TaskGroup group{};
+  for (int b = 0; b < numBlocks; ++b) {
+    auto lo = runStart[b];
+    auto hi = runStart[b + 1];
+    pool.submit(group,
+                [=] { localSort(a + lo, tmp + lo, hi - lo, kind, cmp); });
+  }
+  pool.wait(group);
+
+  mergeRunsParallel(a, tmp, runStart, pool, cmp);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <compare>
+#include <cstdint>
+#include <cstring>
+
+#include "local_sort.hh"
+
+/* Element types beyond plain numbers. They are trivially copyable so that
+ * mpiType derives their MPI datatype, and ordered by operator<=> so that
+ * std::less<> and std::greater<> both work as comparators. */
+
+/* 64-bit key with a payload, a cache line in total */
+struct Record {
+  std::uint64_t key;
+  std::uint64_t payload[7];
+
+  friend auto operator<=>(const Record &x, const Record &y) {
+    return x.key <=> y.key;
+  }
+};
+
+template <> struct RadixKey<Record> {
+  static std::uint64_t get(const Record &r) { return r.key; }
+};
+
+/* Fixed-capacity NUL-padded string, compared bytewise like strcmp */
+template <int N> struct FixedString {
+  char s[N];
+
+  friend auto operator<=>(const FixedString &x, const FixedString &y) {
+    return std::memcmp(x.s, y.s, N) <=> 0;
+  }
+};
+
+using Name = FixedString<16>;
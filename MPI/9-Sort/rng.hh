@@ -0,0 +1,182 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <mpi.h>
+
+#include "records.hh"
+
+/* Counter-based key generator: the key at global index i is a hash of the
+ * seed and i alone, so every rank can produce its own block and the data set
+ * is the same for any number of processes. */
+
+constexpr std::uint64_t SEED = 314159;
+
+/* SplitMix64 finalizer, a bijection on 64-bit integers */
+inline std::uint64_t mix64(std::uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+/* Hash of all bytes of an element, for order-independent checksums */
+template <typename T> std::uint64_t hashElement(const T &v) {
+  const auto *bytes = reinterpret_cast<const unsigned char *>(&v);
+  std::uint64_t h = 0;
+  for (std::size_t i = 0; i < sizeof(T); i += 8) {
+    std::uint64_t word = 0;
+    std::memcpy(&word, bytes + i, std::min<std::size_t>(8, sizeof(T) - i));
+    h = mix64(h ^ word);
+  }
+  return h;
+}
+
+/* First global index and element count of rank's contiguous block */
+inline std::pair<long long, long long> blockRange(long long arrSize,
+                                                  int commSize, int rank) {
+  auto diff = arrSize / commSize;
+  auto rem = arrSize % commSize;
+  auto start = diff * rank + std::min<long long>(rank, rem);
+  return {start, diff + (rank < rem)};
+}
+
+/* Shapes of the generated data:
+ *   uniform - keys uniform over the range
+ *   zipf    - key k drawn with probability ~ 1 / (k + 1)^ZIPF_S, so a few
+ *             small keys make up most of the data
+ *   sorted  - keys ascending with the global index
+ *   reverse - keys descending with the global index
+ *   dups    - only DUP_KEYS distinct keys
+ *   nearly  - sorted, except one element in NEARLY_SORTED is random */
+enum class Dist { Uniform, Zipf, Sorted, Reverse, Dups, NearlySorted };
+
+constexpr Dist ALL_DISTS[] = {Dist::Uniform, Dist::Zipf,    Dist::Sorted,
+                              Dist::Reverse, Dist::Dups,    Dist::NearlySorted};
+
+constexpr double ZIPF_S = 1.2;
+constexpr int DUP_KEYS = 16;
+constexpr int NEARLY_SORTED = 100;
+
+inline const char *distName(Dist dist) {
+  switch (dist) {
+  case Dist::Uniform:
+    return "uniform";
+  case Dist::Zipf:
+    return "zipf";
+  case Dist::Sorted:
+    return "sorted";
+  case Dist::Reverse:
+    return "reverse";
+  case Dist::Dups:
+    return "dups";
+  case Dist::NearlySorted:
+    return "nearly";
+  }
+  return "unknown";
+}
+
+inline bool parseDist(std::string_view name, Dist &dist) {
+  for (auto d : ALL_DISTS)
+    if (name == distName(d)) {
+      dist = d;
+      return true;
+    }
+  return false;
+}
+
+/* Key of global index i out of arrSize, in [0, range) */
+inline std::uint64_t drawKey(long long i, long long arrSize,
+                             std::uint64_t range, Dist dist) {
+  auto h = mix64(SEED ^ mix64(i));
+  /* i scaled to the range, ascending */
+  auto pos = [&] {
+    auto p = static_cast<long double>(i) * range / arrSize;
+    return std::min(range - 1, static_cast<std::uint64_t>(p));
+  };
+  switch (dist) {
+  case Dist::Uniform:
+    break;
+  case Dist::Zipf: {
+    /* Inverse of the continuous power-law distribution function */
+    auto u = (h >> 11) * 0x1p-53;
+    auto top = std::pow(static_cast<double>(range) + 1, 1 - ZIPF_S);
+    auto x = std::pow(1 + u * (top - 1), 1 / (1 - ZIPF_S)) - 1;
+    return std::min(range - 1, static_cast<std::uint64_t>(x));
+  }
+  case Dist::Sorted:
+    return pos();
+  case Dist::Reverse:
+    return range - 1 - pos();
+  case Dist::Dups:
+    return h % std::min<std::uint64_t>(range, DUP_KEYS);
+  case Dist::NearlySorted:
+    return (h % NEARLY_SORTED == 0) ? mix64(h) % range : pos();
+  }
+  return h % range;
+}
+
+/* Element at global index i. Numbers are keys out of a range of arrSize,
+ * so the number of duplicates does not depend on the type; signed types
+ * get negative values too. Records and strings use all of their key
+ * space. */
+template <typename T>
+T makeElement(long long i, long long arrSize, Dist dist = Dist::Uniform) {
+  if constexpr (std::is_same_v<T, int>) {
+    /* Keys must fit an int */
+    return drawKey(i, arrSize, std::min<long long>(arrSize, INT32_MAX), dist);
+  } else if constexpr (std::is_integral_v<T>) {
+    return static_cast<long long>(drawKey(i, arrSize, arrSize, dist)) -
+           arrSize / 2;
+  } else if constexpr (std::is_floating_point_v<T>) {
+    auto key = static_cast<double>(drawKey(i, arrSize, arrSize, dist));
+    return (key - arrSize / 2) / 1024;
+  } else if constexpr (std::is_same_v<T, Record>) {
+    /* Payload is derived from the key, so a record split apart shows up */
+    Record r{};
+    r.key = drawKey(i, arrSize, UINT64_MAX, dist);
+    for (int w = 0; w < 7; ++w)
+      r.payload[w] = mix64(r.key + w);
+    return r;
+  } else {
+    static_assert(std::is_same_v<T, Name>, "no generator for this type");
+    /* Key in base 26, most significant letter first, then random letters */
+    constexpr int KEY_LETTERS = 13;
+    std::uint64_t range = 1;
+    for (int c = 0; c < KEY_LETTERS; ++c)
+      range *= 26;
+    auto key = drawKey(i, arrSize, range, dist);
+    auto h = mix64(SEED ^ mix64(i) ^ 1);
+    Name s{};
+    for (int c = KEY_LETTERS; c-- > 0; key /= 26)
+      s.s[c] = 'a' + key % 26;
+    for (int c = KEY_LETTERS; c + 1 < static_cast<int>(sizeof(s.s)); ++c)
+      s.s[c] = 'a' + (h >> (8 * c)) % 26;
+    return s;
+  }
+}
+
+/* Elements [start, start + count) of the global array */
+template <typename T>
+std::vector<T> generateRange(long long start, int count, long long arrSize,
+                             Dist dist = Dist::Uniform) {
+  std::vector<T> a(count);
+  for (int i = 0; i < count; ++i)
+    a[i] = makeElement<T>(start + i, arrSize, dist);
+  return a;
+}
+
+/* This rank's block of the global array, generated locally */
+template <typename T>
+std::vector<T> generateBlock(long long arrSize, MPI::Intracomm &comm,
+                             Dist dist = Dist::Uniform) {
+  auto [start, count] = blockRange(arrSize, comm.Get_size(), comm.Get_rank());
+  return generateRange<T>(start, count, arrSize, dist);
+}
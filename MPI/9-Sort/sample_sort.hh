@@ -0,0 +1,253 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include <mpi.h>
+
+#include "local_sort.hh"
+#include "loser_tree.hh"
+#include "mpi_type.hh"
+#include "parallel_sort.hh"
+#include "serial_sort.hh"
+#include "sort_stats.hh"
+#include "thread_pool.hh"
+
+/* Parallel sorting by regular sampling (PSRS).
+ *
+ * Every rank sorts its own part, contributes commSize - 1 evenly spaced
+ * samples, rank 0 picks commSize - 1 splitters out of the sorted samples and
+ * broadcasts them, and a single Alltoallv moves every element to the rank
+ * owning its bucket. No rank ever holds more than its bucket, and with
+ * regular sampling no bucket exceeds twice the average size for distinct
+ * keys.
+ *
+ * The commSize sorted runs a rank receives are merged pairwise, in one
+ * k-way pass, or by a k-way merge fed straight from the wire that never
+ * needs the whole bucket in a receive buffer. */
+
+/* commSize - 1 samples at positions (i + 1) * size / commSize of sorted a */
+template <typename T>
+std::vector<T> regularSamples(const std::vector<T> &a, int commSize) {
+  std::vector<T> samples(commSize - 1);
+  for (int i = 0; i < commSize - 1; ++i) {
+    auto pos = static_cast<long long>(i + 1) * a.size() / commSize;
+    samples[i] = a.empty() ? T{} : a[std::min<long long>(pos, a.size() - 1)];
+  }
+  return samples;
+}
+
+/* Gather samples on rank 0, choose splitters there and broadcast them */
+template <typename T, typename Cmp>
+std::vector<T> chooseSplitters(const std::vector<T> &samples, Cmp cmp,
+                               MPI::Intracomm &comm) {
+  auto commSize = comm.Get_size();
+  auto numSamples = static_cast<int>(samples.size());
+  auto type = mpiType<T>();
+
+  std::vector<T> allSamples{};
+  if (comm.Get_rank() == 0)
+    allSamples.resize(numSamples * commSize);
+
+  comm.Gather(samples.data(), numSamples, type, allSamples.data(), numSamples,
+              type, 0);
+
+  std::vector<T> splitters(commSize - 1);
+  if (comm.Get_rank() == 0) {
+    std::sort(allSamples.begin(), allSamples.end(), cmp);
+    for (int i = 0; i < commSize - 1; ++i)
+      splitters[i] = allSamples[(i + 1) * numSamples];
+  }
+
+  comm.Bcast(splitters.data(), commSize - 1, type, 0);
+  return splitters;
+}
+
+/* Number of elements of sorted a that go to every bucket. Bucket i gets
+ * keys in [splitters[i - 1], splitters[i]). */
+template <typename T, typename Cmp>
+std::vector<int> bucketCounts(const std::vector<T> &a,
+                              const std::vector<T> &splitters, Cmp cmp) {
+  std::vector<int> counts(splitters.size() + 1);
+  auto from = a.begin();
+  for (std::size_t i = 0; i < splitters.size(); ++i) {
+    auto to = std::lower_bound(from, a.end(), splitters[i], cmp);
+    counts[i] = to - from;
+    from = to;
+  }
+  counts.back() = a.end() - from;
+  return counts;
+}
+
+inline std::vector<int> displacements(const std::vector<int> &counts) {
+  std::vector<int> displs(counts.size(), 0);
+  for (std::size_t i = 1; i < counts.size(); ++i)
+    displs[i] = displs[i - 1] + counts[i - 1];
+  return displs;
+}
+
+constexpr int STREAM_BUF = 1 << 15; /* elements per buffer of a source */
+constexpr int STREAM_TAG = 91;
+
+/* Sorted run streamed from another rank in pieces of at most STREAM_BUF
+ * elements. Two buffers take turns: the merge reads one while the next
+ * piece lands in the other, so a source never holds more than two pieces
+ * however long its run is. The run from this rank itself is read in place. */
+template <typename T> class RecvSource {
+public:
+  RecvSource(const T *data, int count) : cur_(data), end_(data + count) {}
+
+  RecvSource(int source, int count, MPI::Comm &comm)
+      : comm_(&comm), source_(source), count_(count) {
+    for (auto &b : buf_)
+      b.resize(std::min(STREAM_BUF, count));
+    post(0);
+    post(1);
+    next();
+  }
+
+  bool empty() const { return cur_ == end_; }
+  const T &front() const { return *cur_; }
+  void pop() {
+    if (++cur_ == end_ && comm_)
+      next();
+  }
+
+private:
+  /* Receive the next piece into buffer b */
+  void post(int b) {
+    len_[b] = std::min(STREAM_BUF, count_ - posted_);
+    if (len_[b] > 0)
+      req_[b] = comm_->Irecv(buf_[b].data(), len_[b], mpiType<T>(), source_,
+                             STREAM_TAG);
+    posted_ += len_[b];
+  }
+
+  /* The active buffer is used up: refill it and switch to the other one */
+  void next() {
+    if (active_ >= 0)
+      post(active_);
+    active_ = (active_ + 1) % 2;
+    if (len_[active_] == 0)
+      return;
+    req_[active_].Wait();
+    cur_ = buf_[active_].data();
+    end_ = cur_ + len_[active_];
+  }
+
+  const T *cur_ = nullptr;
+  const T *end_ = nullptr;
+  MPI::Comm *comm_ = nullptr;
+  int source_ = 0;
+  int count_ = 0;
+  int posted_ = 0;
+  int active_ = -1;
+  std::vector<T> buf_[2];
+  int len_[2] = {0, 0};
+  MPI::Request req_[2];
+};
+
+/* Send every bucket of sorted a to its rank in STREAM_BUF pieces and merge
+ * the runs coming in into out while they arrive */
+template <typename T, typename Cmp>
+void exchangeStreaming(const std::vector<T> &a,
+                       const std::vector<int> &sendCounts,
+                       const std::vector<int> &sendDispls,
+                       const std::vector<int> &recvCounts, std::vector<T> &out,
+                       Cmp cmp, MPI::Intracomm &comm) {
+  auto commSize = comm.Get_size();
+  auto rank = comm.Get_rank();
+
+  std::vector<MPI::Request> sends{};
+  for (int r = 0; r < commSize; ++r) {
+    if (r == rank)
+      continue;
+    auto end = sendDispls[r] + sendCounts[r];
+    for (auto lo = sendDispls[r]; lo < end; lo += STREAM_BUF)
+      sends.push_back(comm.Isend(a.data() + lo, std::min(STREAM_BUF, end - lo),
+                                 mpiType<T>(), r, STREAM_TAG));
+  }
+
+  /* Sources in rank order, so that equal keys keep their global order */
+  std::vector<RecvSource<T>> sources{};
+  sources.reserve(commSize);
+  for (int r = 0; r < commSize; ++r) {
+    if (r == rank)
+      sources.emplace_back(a.data() + sendDispls[r], sendCounts[r]);
+    else
+      sources.emplace_back(r, recvCounts[r], comm);
+  }
+  mergeSources(sources, out.begin(), cmp);
+
+  if (!sends.empty())
+    MPI::Request::Waitall(sends.size(), sends.data());
+}
+
+/* Sort the distributed array: a is this rank's part on entry and this
+ * rank's sorted bucket on return. The runs received from all ranks are
+ * combined as merge says. */
+template <typename T, typename Cmp = std::less<>>
+void sampleSort(std::vector<T> &a, LocalSort kind, MergeKind merge,
+                ThreadPool &pool, MPI::Intracomm &comm, Cmp cmp = {},
+                SortStats *stats = nullptr) {
+  auto commSize = comm.Get_size();
+  auto rank = comm.Get_rank();
+  auto start = MPI::Wtime();
+
+  std::vector<T> tmp(a.size());
+  parallelSort(a.begin(), tmp.begin(), a.size(), kind, pool, cmp);
+  auto sorted = MPI::Wtime();
+  if (stats) {
+    stats->localSort += sorted - start;
+    stats->elements = a.size();
+  }
+  if (commSize == 1)
+    return;
+
+  auto splitters = chooseSplitters(regularSamples(a, commSize), cmp, comm);
+
+  auto sendCounts = bucketCounts(a, splitters, cmp);
+  std::vector<int> recvCounts(commSize);
+  comm.Alltoall(sendCounts.data(), 1, MPI::INT, recvCounts.data(), 1,
+                MPI::INT);
+
+  auto sendDispls = displacements(sendCounts);
+  auto recvDispls = displacements(recvCounts);
+
+  std::vector<T> bucket(recvDispls.back() + recvCounts.back());
+  if (stats) {
+    stats->bytesSent += (a.size() - sendCounts[rank]) * sizeof(T);
+    stats->elements = bucket.size();
+  }
+  if (merge == MergeKind::Stream) {
+    tmp.clear();
+    tmp.shrink_to_fit();
+    exchangeStreaming(a, sendCounts, sendDispls, recvCounts, bucket, cmp,
+                      comm);
+    a.swap(bucket);
+    if (stats)
+      stats->exchange += MPI::Wtime() - sorted;
+    return;
+  }
+
+  auto type = mpiType<T>();
+  comm.Alltoallv(a.data(), sendCounts.data(), sendDispls.data(), type,
+                 bucket.data(), recvCounts.data(), recvDispls.data(), type);
+  auto exchanged = MPI::Wtime();
+  if (stats)
+    stats->exchange += exchanged - sorted;
+
+  /* The bucket consists of commSize sorted runs, one from every rank */
+  recvDispls.push_back(bucket.size());
+  tmp.resize(bucket.size());
+  if (merge == MergeKind::KWay) {
+    mergeRunsKWay(bucket.begin(), tmp.begin(), recvDispls, pool, cmp);
+    a.swap(tmp);
+  } else {
+    mergeRunsParallel(bucket.begin(), tmp.begin(), recvDispls, pool, cmp);
+    a.swap(bucket);
+  }
+  if (stats)
+    stats->merge += MPI::Wtime() - exchanged;
+}
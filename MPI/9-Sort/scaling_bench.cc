@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <mpi.h>
+
+#include "dist_io.hh"
+#include "local_sort.hh"
+#include "loser_tree.hh"
+#include "records.hh"
+#include "rng.hh"
+#include "sample_sort.hh"
+#include "sort_stats.hh"
+#include "thread_pool.hh"
+#include "tree_sort.hh"
+#include "verify.hh"
+
+/* Both engines over a set of input distributions, one CSV row per run:
+ * time of every phase (the slowest rank's), bytes every rank sent and the
+ * load imbalance, i.e. the largest bucket (sample sort) or own part (tree
+ * sort) over the average one. */
+
+enum class Algo { Tree, Sample };
+
+struct BenchOptions {
+  long long arrSize = -1;
+  std::vector<Dist> dists{std::begin(ALL_DISTS), std::end(ALL_DISTS)};
+  std::vector<Algo> algos{Algo::Tree, Algo::Sample};
+  MergeKind merge = MergeKind::KWay;
+  LocalSort local = LocalSort::Radix;
+  int threads = 1;
+  bool distGen = false; /* every rank generates its own block */
+  std::string type = "int";
+  int repeat = 3;
+  const char *csv = nullptr; /* stdout if not given */
+};
+
+bool parseOptions(int ac, char **av, BenchOptions &opts);
+template <typename T>
+std::string runOnce(const BenchOptions &opts, Dist dist, Algo algo, int rep,
+                    MPI::Intracomm &comm);
+
+int main(int ac, char **av) {
+  auto provided = MPI::Init_thread(ac, av, MPI::THREAD_FUNNELED);
+  auto &comm = MPI::COMM_WORLD;
+  auto rank = comm.Get_rank();
+
+  BenchOptions opts{};
+  if (!parseOptions(ac, av, opts)) {
+    if (rank == 0)
+      std::cerr << "Usage: " << av[0]
+                << " array-size [--dists d1,d2,...] [--algos tree,sample]"
+                   " [--merge pairwise|kway|stream]"
+                   " [--local merge|pingpong|bitonic|radix|std]"
+                   " [--threads N] [--gen root|dist]"
+                   " [--type int|long|record] [--repeat N] [--csv file]\n"
+                   "distributions: uniform zipf sorted reverse dups nearly"
+                << std::endl;
+    comm.Abort(1);
+  }
+
+  /* Without FUNNELED, no other thread may even exist: sort on this one */
+  if (provided < MPI::THREAD_FUNNELED && opts.threads > 1) {
+    if (rank == 0)
+      std::cerr << "MPI without MPI_THREAD_FUNNELED, using --threads 1"
+                << std::endl;
+    opts.threads = 1;
+  }
+
+  std::ofstream file{};
+  if (rank == 0 && opts.csv)
+    file.open(opts.csv);
+  std::ostream &out = (opts.csv) ? file : std::cout;
+  if (rank == 0)
+    out << "dist,algo,merge,local,type,procs,threads,size,rep,ok,total,"
+           "distribute,local_sort,exchange,merge_time,bytes_max,bytes_mean,"
+           "imbalance,bytes_per_rank"
+        << std::endl;
+
+  for (auto dist : opts.dists)
+    for (auto algo : opts.algos)
+      for (int rep = 0; rep < opts.repeat; ++rep) {
+        std::string row{};
+        if (opts.type == "int")
+          row = runOnce<int>(opts, dist, algo, rep, comm);
+        else if (opts.type == "long")
+          row = runOnce<long long>(opts, dist, algo, rep, comm);
+        else
+          row = runOnce<Record>(opts, dist, algo, rep, comm);
+        if (rank == 0)
+          out << row << std::endl;
+      }
+
+  MPI::Finalize();
+  return 0;
+}
+
+/* Comma-separated list of names known to parse */
+template <typename E, typename Parse>
+bool parseList(std::string_view list, std::vector<E> &items, Parse parse) {
+  items.clear();
+  while (!list.empty()) {
+    auto comma = std::min(list.find(','), list.size());
+    E item{};
+    if (!parse(list.substr(0, comma), item))
+      return false;
+    items.push_back(item);
+    list.remove_prefix(std::min(comma + 1, list.size()));
+  }
+  return !items.empty();
+}
+
+bool parseOptions(int ac, char **av, BenchOptions &opts) {
+  if (ac < 2)
+    return false;
+
+  opts.arrSize = atoll(av[1]);
+  for (int i = 2; i < ac; ++i) {
+    std::string_view arg = av[i];
+    if (i + 1 == ac)
+      return false;
+    std::string_view val = av[++i];
+    auto parseAlgo = [](std::string_view name, Algo &algo) {
+      if (name != "tree" && name != "sample")
+        return false;
+      algo = (name == "tree") ? Algo::Tree : Algo::Sample;
+      return true;
+    };
+    if (arg == "--dists" && val == "all")
+      opts.dists.assign(std::begin(ALL_DISTS), std::end(ALL_DISTS));
+    else if (arg == "--dists" && parseList(val, opts.dists, parseDist))
+      continue;
+    else if (arg == "--algos" && parseList(val, opts.algos, parseAlgo))
+      continue;
+    else if (arg == "--merge" && parseMergeKind(val, opts.merge))
+      continue;
+    else if (arg == "--local" && parseLocalSort(val, opts.local))
+      continue;
+    else if (arg == "--threads")
+      opts.threads = atoi(av[i]);
+    else if (arg == "--gen" && (val == "root" || val == "dist"))
+      opts.distGen = (val == "dist");
+    else if (arg == "--type" &&
+             (val == "int" || val == "long" || val == "record"))
+      opts.type = val;
+    else if (arg == "--repeat")
+      opts.repeat = atoi(av[i]);
+    else if (arg == "--csv")
+      opts.csv = av[i];
+    else
+      return false;
+  }
+  return opts.arrSize > 0 && opts.arrSize < INT32_MAX && opts.threads > 0 &&
+         opts.repeat > 0;
+}
+
+/* Sort one data set and return its CSV row (on rank 0) */
+template <typename T>
+std::string runOnce(const BenchOptions &opts, Dist dist, Algo algo, int rep,
+                    MPI::Intracomm &comm) {
+  auto rank = comm.Get_rank();
+  auto commSize = comm.Get_size();
+  SortStats stats{};
+
+  /* The tree engine starts from the whole array on rank 0; scattering it
+   * for the sample sort counts as its distribution phase */
+  std::vector<T> a{};
+  if (algo == Algo::Tree || !opts.distGen) {
+    if (rank == 0)
+      a = generateRange<T>(0, opts.arrSize, opts.arrSize, dist);
+  } else {
+    a = generateBlock<T>(opts.arrSize, comm, dist);
+  }
+  auto sumBefore = checksum(a, comm);
+  ThreadPool pool{opts.threads};
+
+  comm.Barrier();
+  auto start = MPI::Wtime();
+  if (algo == Algo::Tree) {
+    treeSort(a, opts.local, opts.merge, pool, comm, std::less<>{}, &stats);
+  } else {
+    if (!opts.distGen) {
+      a = distribute(a, opts.arrSize, comm);
+      stats.distribute = MPI::Wtime() - start;
+      if (rank == 0)
+        stats.bytesSent += (opts.arrSize - a.size()) * sizeof(T);
+    }
+    sampleSort(a, opts.local, opts.merge, pool, comm, std::less<>{}, &stats);
+  }
+  comm.Barrier();
+  auto total = MPI::Wtime() - start;
+
+  int ok = isSortedDistributed(a, opts.arrSize, std::less<>{}, comm) &&
+           checksum(a, comm) == sumBefore;
+
+  double phases[4] = {stats.distribute, stats.localSort, stats.exchange,
+                      stats.merge};
+  double maxPhases[4] = {};
+  comm.Reduce(phases, maxPhases, 4, MPI::DOUBLE, MPI::MAX, 0);
+  std::vector<long long> bytes(commSize);
+  std::vector<long long> elements(commSize);
+  comm.Gather(&stats.bytesSent, 1, MPI::LONG_LONG, bytes.data(), 1,
+              MPI::LONG_LONG, 0);
+  comm.Gather(&stats.elements, 1, MPI::LONG_LONG, elements.data(), 1,
+              MPI::LONG_LONG, 0);
+  if (rank != 0)
+    return {};
+
+  auto sumBytes = std::accumulate(bytes.begin(), bytes.end(), 0LL);
+  auto sumElements = std::accumulate(elements.begin(), elements.end(), 0LL);
+  auto maxElements = *std::max_element(elements.begin(), elements.end());
+  auto imbalance = sumElements ? static_cast<double>(maxElements) *
+                                     commSize / sumElements
+                               : 1.0;
+
+  std::ostringstream row{};
+  row << distName(dist) << ',' << (algo == Algo::Tree ? "tree" : "sample")
+      << ',' << mergeKindName(opts.merge) << ',' << localSortName(opts.local)
+      << ',' << opts.type << ',' << commSize << ',' << opts.threads << ','
+      << opts.arrSize << ',' << rep << ',' << ok << ',' << total;
+  for (auto t : maxPhases)
+    row << ',' << t;
+  row << ',' << *std::max_element(bytes.begin(), bytes.end()) << ','
+      << sumBytes / commSize << ',' << imbalance << ',';
+  for (int r = 0; r < commSize; ++r)
+    row << (r ? ";" : "") << bytes[r];
+  return row.str();
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+/* Serial kernels work on random access iterators of any element type and
+ * take the comparator last; std::less<> orders by operator< */
+
+constexpr int SMALL = 32;
+
+template <typename It, typename Cmp = std::less<>>
+void insertionSort(It a, int size, Cmp cmp = {}) {
+  for (int i = 0; i < size; ++i) {
+    int j;
+    auto v = a[i];
+    for (j = i - 1; j >= 0; j--) {
+      if (!cmp(v, a[j]))
+        break;
+      a[j + 1] = a[j];
+    }
+    a[j + 1] = v;
+  }
+}
+
+template <typename It, typename Cmp = std::less<>>
+void merge(It a, It tmp, int size, Cmp cmp = {}) {
+  int i1 = 0;
+  int i2 = size / 2;
+  int tmpi = 0;
+  while (i1 < size / 2 && i2 < size) {
+    if (cmp(a[i1], a[i2])) {
+      tmp[tmpi] = a[i1];
+      ++i1;
+    } else {
+      tmp[tmpi] = a[i2];
+      ++i2;
+    }
+    ++tmpi;
+  }
+  while (i1 < size / 2) {
+    tmp[tmpi] = a[i1];
+    ++i1;
+    ++tmpi;
+  }
+  while (i2 < size) {
+    tmp[tmpi] = a[i2];
+    ++i2;
+    ++tmpi;
+  }
+  /* Copy sorted tmp array into main array, a */
+  std::copy_n(tmp, size, a);
+}
+
+template <typename It, typename Cmp = std::less<>>
+void mergeSortSerial(It a, It tmp, int size, Cmp cmp = {}) {
+  /* Switch to insertion sort for small arrays */
+  if (size <= SMALL) {
+    insertionSort(a, size, cmp);
+    return;
+  }
+  mergeSortSerial(a, tmp, size / 2, cmp);
+  mergeSortSerial(a + size / 2, tmp, size - size / 2, cmp);
+  /* Merge the two sorted subarrays into a tmp array */
+  merge(a, tmp, size, cmp);
+}
+
+/* Merge sorted runs a[runStart[i], runStart[i + 1]) pairwise, ping-ponging
+ * between a and tmp, until one run is left in a */
+template <typename It, typename Cmp = std::less<>>
+void mergeRuns(It a, It tmp, std::vector<int> runStart, Cmp cmp = {}) {
+  auto src = a;
+  auto dst = tmp;
+  while (runStart.size() > 2) {
+    std::vector<int> merged{runStart[0]};
+    std::size_t i = 0;
+    for (; i + 2 < runStart.size(); i += 2) {
+      std::merge(src + runStart[i], src + runStart[i + 1],
+                 src + runStart[i + 1], src + runStart[i + 2],
+                 dst + runStart[i], cmp);
+      merged.push_back(runStart[i + 2]);
+    }
+    if (i + 1 < runStart.size()) { /* odd run out */
+      std::copy(src + runStart[i], src + runStart[i + 1], dst + runStart[i]);
+      merged.push_back(runStart[i + 1]);
+    }
+    std::swap(src, dst);
+    runStart.swap(merged);
+  }
+  if (src != a)
+    std::copy(src + runStart.front(), src + runStart.back(),
+              a + runStart.front());
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+/* What one rank spent on a sort, filled in by the engines when asked for.
+ * Phases may overlap: the tree engine sorts its own pieces while the rest
+ * of its part is still being distributed, and the streaming sample sort
+ * merges during the exchange, which it then counts as exchange. */
+struct SortStats {
+  double distribute = 0; /* receiving the input from the parent rank */
+  double localSort = 0;  /* sorting this rank's own part */
+  double exchange = 0;   /* splitters and moving elements to their ranks */
+  double merge = 0;      /* merging runs, waiting for helpers included */
+  long long bytesSent = 0; /* elements sent to other ranks, in bytes */
+  long long elements = 0;  /* bucket (sample) or own part (tree) size */
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Tasks submitted together and waited for together */
+class TaskGroup {
+  friend class ThreadPool;
+  std::atomic<int> pending{0};
+};
+
+/* Fixed set of worker threads taking tasks from one queue. The thread that
+ * waits for a group runs queued tasks meanwhile, so tasks may submit and
+ * wait for tasks of their own, and a pool of size 1 runs everything on the
+ * calling thread. */
+class ThreadPool {
+public:
+  explicit ThreadPool(int numThreads) {
+    for (int i = 1; i < numThreads; ++i)
+      workers_.emplace_back([this] { workerLoop(); });
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard lock{mutex_};
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto &worker : workers_)
+      worker.join();
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  int size() const { return workers_.size() + 1; }
+
+  void submit(TaskGroup &group, std::function<void()> fn) {
+    group.pending.fetch_add(1);
+    {
+      std::lock_guard lock{mutex_};
+      queue_.push_back({&group, std::move(fn)});
+    }
+    cv_.notify_one();
+  }
+
+  void wait(TaskGroup &group) {
+    while (group.pending.load() > 0)
+      if (!runOne())
+        std::this_thread::yield();
+  }
+
+private:
+  struct Task {
+    TaskGroup *group;
+    std::function<void()> fn;
+  };
+
+  bool runOne() {
+    Task task{};
+    {
+      std::lock_guard lock{mutex_};
+      if (queue_.empty())
+        return false;
+      task = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    task.fn();
+    task.group->pending.fetch_sub(1);
+    return true;
+  }
+
+  void workerLoop() {
+    for (;;) {
+      Task task{};
+      {
+        std::unique_lock lock{mutex_};
+        cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+        if (queue_.empty())
+          return;
+        task = std::move(queue_.front());
+        queue_.pop_front();
+      }
+      task.fn();
+      task.group->pending.fetch_sub(1);
+    }
+  }
+
+  std::vector<std::thread> workers_;
+  std::deque<Task> queue_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+};
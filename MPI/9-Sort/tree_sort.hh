@@ -0,0 +1,441 @@
+#pragma once
+
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include <mpi.h>
+
+#include "local_sort.hh"
+#include "loser_tree.hh"
+#include "mpi_type.hh"
+#include "parallel_sort.hh"
+#include "serial_sort.hh"
+#include "sort_stats.hh"
+#include "thread_pool.hh"
+
+/* Binary-tree merge sort: a node ships the second half of its array to
+ * rank + 2^level, halves the rest for rank + 2^(level + 1) and so on, sorts
+ * what is left and merges the helpers' sorted parts back in.
+ *
+ * All transfers are split into CHUNK-sized pieces sent with Isend and
+ * completed with Wait before their memory is reused. Arrays travel back to
+ * front, so a node forwards its helpers' parts as soon as they arrive and
+ * sorts the pieces of its own part while the rest is still on the wire.
+ * Sorted results travel front to back and are merged as they arrive; a
+ * helper's final merge is streamed to its parent piece by piece.
+ *
+ * With a k-way merge a node instead combines its own sorted part and all
+ * helpers' results in a single loser-tree pass fed by the pieces as they
+ * arrive, so every element is copied once per node rather than once per
+ * helper.
+ *
+ * With more than one thread the pieces of a node's own part are sorted by
+ * pool tasks while the calling thread keeps serving MPI, which therefore
+ * only needs MPI::THREAD_FUNNELED. */
+
+constexpr int CHUNK = 1 << 16; /* elements per pipelined message */
+
+/* [lo, hi) of the array, transferred as one message */
+struct Piece {
+  int lo;
+  int hi;
+};
+
+/* Pieces of [lo, hi), highest first */
+inline std::vector<Piece> piecesBackward(int lo, int hi) {
+  std::vector<Piece> pieces{};
+  for (auto end = hi; end > lo; end -= std::min(CHUNK, end - lo))
+    pieces.push_back({std::max(lo, end - CHUNK), end});
+  return pieces;
+}
+
+/* Pieces of [lo, hi), lowest first */
+inline std::vector<Piece> piecesForward(int lo, int hi) {
+  std::vector<Piece> pieces{};
+  for (auto begin = lo; begin < hi; begin += std::min(CHUNK, hi - begin))
+    pieces.push_back({begin, std::min(hi, begin + CHUNK)});
+  return pieces;
+}
+
+/* Given a process rank, calculate the top level of the process tree in which */
+/* the process participates Root assumed to always have rank 0 and to */
+/* participate at level 0 of the process tree */
+inline int topmostLevel(int rank) {
+  int level = 0;
+  while (pow(2, level) <= rank)
+    ++level;
+  return level;
+}
+
+/* Helper j of a node gets a[bounds[j + 1], bounds[j]); the node keeps
+ * a[0, bounds.back()) */
+struct TreePlan {
+  std::vector<int> helpers;
+  std::vector<int> bounds;
+};
+
+inline TreePlan makePlan(int size, int level, int rank, int maxRank) {
+  TreePlan plan{{}, {size}};
+  auto helperRank = rank + static_cast<int>(pow(2, level));
+  while (helperRank <= maxRank) { /* until no more processes available */
+    plan.helpers.push_back(helperRank);
+    plan.bounds.push_back(plan.bounds.back() / 2);
+    helperRank = rank + static_cast<int>(pow(2, ++level));
+  }
+  return plan;
+}
+
+template <typename T>
+std::vector<MPI::Request> isendPieces(const T *buf,
+                                      const std::vector<Piece> &pieces,
+                                      int dest, int tag, MPI::Comm &comm) {
+  std::vector<MPI::Request> requests{};
+  for (auto [lo, hi] : pieces)
+    requests.push_back(comm.Isend(buf + lo, hi - lo, mpiType<T>(), dest, tag));
+  return requests;
+}
+
+template <typename T>
+std::vector<MPI::Request> irecvPieces(T *buf, const std::vector<Piece> &pieces,
+                                      int source, int tag, MPI::Comm &comm) {
+  std::vector<MPI::Request> requests{};
+  for (auto [lo, hi] : pieces)
+    requests.push_back(
+        comm.Irecv(buf + lo, hi - lo, mpiType<T>(), source, tag));
+  return requests;
+}
+
+inline void waitAll(std::vector<MPI::Request> &requests) {
+  if (!requests.empty())
+    MPI::Request::Waitall(requests.size(), requests.data());
+  requests.clear();
+}
+
+/* Merge sorted a[0, mid) with the run after it into tmp. The second run
+ * arrives as pieces completed by recvs in order; output is produced as far as
+ * the data received so far allows. Whenever out elements of tmp are final,
+ * emit(out) is called. */
+template <typename It, typename Cmp, typename Emit>
+void mergeStreaming(It a, It tmp, int mid, const std::vector<Piece> &pieces,
+                    std::vector<MPI::Request> &recvs, Cmp cmp, Emit emit) {
+  int i1 = 0;
+  int i2 = mid;
+  int tmpi = 0;
+  int avail = mid; /* a[mid, avail) has arrived */
+  for (std::size_t p = 0; p <= pieces.size(); ++p) {
+    if (p > 0) {
+      recvs[p - 1].Wait();
+      avail = pieces[p - 1].hi;
+    }
+    auto last = (p == pieces.size());
+    while (i2 < avail && (i1 < mid || last)) {
+      if (i1 < mid && cmp(a[i1], a[i2]))
+        tmp[tmpi++] = a[i1++];
+      else
+        tmp[tmpi++] = a[i2++];
+    }
+    if (last)
+      while (i1 < mid)
+        tmp[tmpi++] = a[i1++];
+    emit(tmpi);
+  }
+  recvs.clear();
+}
+
+/* Sorted run a[lo, hi) whose pieces are still being received: moving on
+ * into the next piece waits for it */
+template <typename T> class PieceSource {
+public:
+  /* Run already in memory */
+  PieceSource(T *lo, T *hi) : data_(lo), cur_(lo), avail_(hi), end_(hi) {}
+
+  PieceSource(T *data, std::vector<Piece> pieces,
+              std::vector<MPI::Request> recvs)
+      : data_(data), pieces_(std::move(pieces)), recvs_(std::move(recvs)) {
+    if (!pieces_.empty()) {
+      cur_ = avail_ = data_ + pieces_.front().lo;
+      end_ = data_ + pieces_.back().hi;
+      arrive();
+    }
+  }
+
+  bool empty() const { return cur_ == end_; }
+  const T &front() const { return *cur_; }
+  void pop() {
+    if (++cur_ == avail_ && cur_ != end_)
+      arrive();
+  }
+
+private:
+  void arrive() {
+    recvs_[next_].Wait();
+    avail_ = data_ + pieces_[next_++].hi;
+  }
+
+  T *data_;
+  std::vector<Piece> pieces_;
+  std::vector<MPI::Request> recvs_;
+  std::size_t next_ = 0;
+  T *cur_ = nullptr;
+  T *avail_ = nullptr;
+  T *end_ = nullptr;
+};
+
+/* Merge this node's sorted a[0, bounds.back()) with all helpers' results
+ * in one pass into tmp, then into a or, for a helper, to its parent as the
+ * output is produced */
+template <typename T, typename Cmp>
+void mergeHelpersKWay(std::vector<T> &a, std::vector<T> &tmp,
+                      const TreePlan &plan, int parent, int tag,
+                      std::vector<std::vector<MPI::Request>> &sends, Cmp cmp,
+                      MPI::Comm &comm) {
+  auto numHelpers = plan.helpers.size();
+  auto size = plan.bounds.front();
+
+  /* Sources in array order: the local part, then the helpers' parts from
+   * the smallest */
+  std::vector<PieceSource<T>> sources{};
+  sources.emplace_back(a.data(), a.data() + plan.bounds.back());
+  for (auto j = numHelpers; j-- > 0;) {
+    /* A part's memory is reused for the result only after its sends have
+     * completed */
+    waitAll(sends[j]);
+    auto pieces = piecesForward(plan.bounds[j + 1], plan.bounds[j]);
+    auto recvs = irecvPieces(a.data(), pieces, plan.helpers[j], tag, comm);
+    sources.emplace_back(a.data(), std::move(pieces), std::move(recvs));
+  }
+
+  if (parent < 0) {
+    mergeSources(sources, tmp.begin(), cmp);
+    a.swap(tmp);
+    return;
+  }
+
+  auto type = mpiType<T>();
+  std::vector<MPI::Request> backSends{};
+  int sent = 0;
+  mergeSources(sources, tmp.begin(), cmp, CHUNK, [&](long long done) {
+    for (; sent < done; sent += CHUNK) {
+      auto n = std::min<long long>(CHUNK, size - sent);
+      backSends.push_back(
+          comm.Isend(tmp.data() + sent, n, type, parent, tag));
+    }
+  });
+  waitAll(backSends);
+}
+
+/* Last part of sortNode: return the sorted array to the parent, merging
+ * the helpers' results into it first */
+template <typename T, typename Cmp>
+void sortNodeMerge(std::vector<T> &a, std::vector<T> &tmp,
+                   const TreePlan &plan, int parent, int tag, MergeKind merge,
+                   Cmp cmp, MPI::Comm &comm,
+                   std::vector<std::vector<MPI::Request>> &sends) {
+  auto type = mpiType<T>();
+  auto numHelpers = plan.helpers.size();
+  auto size = plan.bounds.front();
+
+  if (numHelpers == 0 && parent >= 0) {
+    auto back =
+        isendPieces(a.data(), piecesForward(0, size), parent, tag, comm);
+    waitAll(back);
+    return;
+  }
+
+  if (merge != MergeKind::Pairwise) {
+    mergeHelpersKWay(a, tmp, plan, parent, tag, sends, cmp, comm);
+    return;
+  }
+
+  /* Merge the helpers' results, smallest part first */
+  for (auto j = numHelpers; j-- > 0;) {
+    /* The part's memory is reused for the result only after its sends
+     * have completed */
+    waitAll(sends[j]);
+
+    auto mid = plan.bounds[j + 1];
+    auto end = plan.bounds[j];
+    auto pieces = piecesForward(mid, end);
+    auto resRecvs = irecvPieces(a.data(), pieces, plan.helpers[j], tag, comm);
+
+    if (j > 0 || parent < 0) {
+      mergeStreaming(a.begin(), tmp.begin(), mid, pieces, resRecvs, cmp,
+                     [](int) {});
+      std::copy_n(tmp.begin(), end, a.begin());
+      continue;
+    }
+
+    /* Final merge of a helper: send the result to the parent as it is
+     * produced */
+    auto back = piecesForward(0, end);
+    std::vector<MPI::Request> backSends{};
+    std::size_t nextBack = 0;
+    mergeStreaming(a.begin(), tmp.begin(), mid, pieces, resRecvs, cmp,
+                   [&](int done) {
+                     for (; nextBack < back.size() && back[nextBack].hi <= done;
+                          ++nextBack) {
+                       auto [lo, hi] = back[nextBack];
+                       backSends.push_back(comm.Isend(tmp.data() + lo, hi - lo,
+                                                      type, parent, tag));
+                     }
+                   });
+    waitAll(backSends);
+  }
+}
+
+/* Sort a[0, size) at this node. parent < 0 means the data is already in a;
+ * otherwise it is being received from parent and the result is sent back to
+ * it. */
+template <typename T, typename Cmp>
+void sortNode(std::vector<T> &a, std::vector<T> &tmp, int size, int level,
+              int rank, int maxRank, int parent, int tag, LocalSort kind,
+              MergeKind merge, Cmp cmp, ThreadPool &pool, MPI::Comm &comm,
+              SortStats *stats) {
+  auto start = MPI::Wtime();
+  auto type = mpiType<T>();
+  auto plan = makePlan(size, level, rank, maxRank);
+  auto numHelpers = plan.helpers.size();
+  auto localSize = plan.bounds.back();
+  if (stats) {
+    /* The helpers' parts go down, the whole sorted array back up */
+    auto sent = size - localSize + ((parent >= 0) ? size : 0);
+    stats->bytesSent += static_cast<long long>(sent) * sizeof(T);
+    stats->elements = localSize;
+  }
+
+  /* Tell every helper how much to expect */
+  for (std::size_t j = 0; j < numHelpers; ++j) {
+    int helperSize = plan.bounds[j] - plan.bounds[j + 1];
+    comm.Send(&helperSize, 1, MPI::INT, plan.helpers[j], tag);
+  }
+
+  std::vector<Piece> incoming{};
+  std::vector<MPI::Request> recvs{};
+  if (parent >= 0) {
+    incoming = piecesBackward(0, size);
+    recvs = irecvPieces(a.data(), incoming, parent, tag, comm);
+  }
+
+  /* Forward and sort pieces as the part of a they cover becomes available */
+  std::vector<std::vector<Piece>> outgoing(numHelpers);
+  std::vector<std::size_t> nextOut(numHelpers, 0);
+  std::vector<std::vector<MPI::Request>> sends(numHelpers);
+  for (std::size_t j = 0; j < numHelpers; ++j)
+    outgoing[j] = piecesBackward(plan.bounds[j + 1], plan.bounds[j]);
+
+  auto localPieces = piecesBackward(0, localSize);
+  std::size_t nextLocal = 0;
+  std::vector<int> runStart{localSize};
+  TaskGroup localSorts{};
+
+  auto avail = (parent >= 0) ? size : 0; /* a[avail, size) is present */
+  for (std::size_t p = 0;; ++p) {
+    for (std::size_t j = 0; j < numHelpers; ++j) {
+      for (; nextOut[j] < outgoing[j].size() &&
+             outgoing[j][nextOut[j]].lo >= avail;
+           ++nextOut[j]) {
+        auto [lo, hi] = outgoing[j][nextOut[j]];
+        sends[j].push_back(
+            comm.Isend(a.data() + lo, hi - lo, type, plan.helpers[j], tag));
+      }
+    }
+    for (; nextLocal < localPieces.size() &&
+           localPieces[nextLocal].lo >= avail;
+         ++nextLocal) {
+      auto [lo, hi] = localPieces[nextLocal];
+      auto piece = a.begin() + lo;
+      auto scratch = tmp.begin() + lo;
+      /* A pool of size 1 would only run it in wait, after the last
+       * receive: sort it now so it still overlaps the transfers. */
+      if (pool.size() == 1)
+        localSort(piece, scratch, hi - lo, kind, cmp);
+      else
+        pool.submit(localSorts,
+                    [=] { localSort(piece, scratch, hi - lo, kind, cmp); });
+      runStart.push_back(lo);
+    }
+    if (p == incoming.size())
+      break;
+    recvs[p].Wait();
+    avail = incoming[p].lo;
+  }
+  auto distributed = MPI::Wtime();
+
+  pool.wait(localSorts);
+  std::reverse(runStart.begin(), runStart.end());
+  if (runStart.size() == 1)
+    runStart.insert(runStart.begin(), 0);
+  mergeRunsParallel(a.begin(), tmp.begin(), runStart, pool, cmp);
+  auto sorted = MPI::Wtime();
+  if (stats) {
+    stats->distribute += distributed - start;
+    stats->localSort += sorted - distributed;
+  }
+  sortNodeMerge(a, tmp, plan, parent, tag, merge, cmp, comm, sends);
+  if (stats)
+    stats->merge += MPI::Wtime() - sorted;
+}
+
+/* Root process code */
+template <typename T, typename Cmp>
+void runRootMPI(std::vector<T> &a, std::vector<T> &tmp, int maxRank, int tag,
+                LocalSort kind, MergeKind merge, Cmp cmp, ThreadPool &pool,
+                MPI::Comm &comm, SortStats *stats = nullptr) {
+  auto rank = comm.Get_rank();
+  if (rank != 0) {
+    std::cerr << "Error: run_root_mpi called from process " << rank
+              << "; must be called from process 0 only" << std::endl;
+    MPI::COMM_WORLD.Abort(1);
+  }
+
+  sortNode(a, tmp, a.size(), 0, rank, maxRank, -1, tag, kind, merge, cmp,
+           pool, comm, stats);
+  /* level=0; rank=root_rank=0; */
+  return;
+}
+
+/* Helper process code */
+template <typename T, typename Cmp>
+void runHelperMPI(int rank, int maxRank, int tag, LocalSort kind,
+                  MergeKind merge, Cmp cmp, ThreadPool &pool, MPI::Comm &comm,
+                  SortStats *stats = nullptr) {
+  auto level = topmostLevel(rank);
+  /* probe for the size message and determine the sender */
+  MPI::Status status{};
+  comm.Probe(MPI::ANY_SOURCE, tag, status);
+  auto parentRank = status.Get_source();
+
+  int size{};
+  comm.Recv(&size, 1, MPI::INT, parentRank, tag);
+
+  std::vector<T> a{};
+  a.resize(size);
+  std::vector<T> tmp = a;
+
+  sortNode(a, tmp, size, level, rank, maxRank, parentRank, tag, kind, merge,
+           cmp, pool, comm, stats);
+  return;
+}
+
+/* Binary-tree merge sort of the array a on rank 0; other ranks are
+ * helpers and end with a empty */
+template <typename T, typename Cmp = std::less<>>
+void treeSort(std::vector<T> &a, LocalSort kind, MergeKind merge,
+              ThreadPool &pool, MPI::Intracomm &comm, Cmp cmp = {},
+              SortStats *stats = nullptr) {
+  auto maxRank = comm.Get_size() - 1;
+  int tag = 123;
+
+  /* Only root process sets test data */
+  if (comm.Get_rank() != 0) {
+    runHelperMPI<T>(comm.Get_rank(), maxRank, tag, kind, merge, cmp, pool,
+                    comm, stats);
+    return;
+  }
+
+  auto tmp{a};
+  runRootMPI(a, tmp, maxRank, tag, kind, merge, cmp, pool, comm, stats);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <mpi.h>
+
+#include "mpi_type.hh"
+#include "rng.hh"
+
+/* Checks of a distributed sort result */
+
+/* Order-independent sum of all element hashes, catches lost, duplicated or
+ * torn elements */
+template <typename T>
+std::uint64_t checksum(const std::vector<T> &a, MPI::Intracomm &comm) {
+  unsigned long long sum = 0;
+  for (auto &v : a)
+    sum += hashElement(v);
+
+  unsigned long long total = 0;
+  comm.Allreduce(&sum, &total, 1, MPI::UNSIGNED_LONG_LONG, MPI::SUM);
+  return total;
+}
+
+/* Buckets known by their sortedness, size and first and last elements are
+ * ordered across ranks and hold arrSize elements in total */
+template <typename T, typename Cmp>
+bool isOrderedDistributed(bool sorted, long long count, const T &first,
+                          const T &last, long long arrSize, Cmp cmp,
+                          MPI::Intracomm &comm) {
+  auto rank = comm.Get_rank();
+  auto commSize = comm.Get_size();
+  auto type = mpiType<T>();
+
+  int ok = sorted;
+
+  /* Pass the last element to the next rank, empty buckets pass it through */
+  T prevLast{};
+  int hasPrev = 0;
+  if (rank > 0) {
+    comm.Recv(&hasPrev, 1, MPI::INT, rank - 1, 0);
+    comm.Recv(&prevLast, 1, type, rank - 1, 0);
+  }
+  if (hasPrev && count > 0 && cmp(first, prevLast))
+    ok = 0;
+  if (rank < commSize - 1) {
+    int hasLast = hasPrev || count > 0;
+    T lastSeen = (count == 0) ? prevLast : last;
+    comm.Send(&hasLast, 1, MPI::INT, rank + 1, 0);
+    comm.Send(&lastSeen, 1, type, rank + 1, 0);
+  }
+
+  long long total = 0;
+  int allOk = 0;
+  comm.Allreduce(&count, &total, 1, MPI::LONG_LONG, MPI::SUM);
+  comm.Allreduce(&ok, &allOk, 1, MPI::INT, MPI::LAND);
+  return allOk && total == arrSize;
+}
+
+/* Every bucket is sorted, buckets are ordered across ranks and no element
+ * has been lost */
+template <typename T, typename Cmp>
+bool isSortedDistributed(const std::vector<T> &a, long long arrSize, Cmp cmp,
+                         MPI::Intracomm &comm) {
+  auto sorted = std::is_sorted(a.begin(), a.end(), cmp);
+  if (a.empty())
+    return isOrderedDistributed(sorted, 0, T{}, T{}, arrSize, cmp, comm);
+  return isOrderedDistributed(sorted, a.size(), a.front(), a.back(), arrSize,
+                              cmp, comm);
+}
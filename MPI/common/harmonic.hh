@@ -0,0 +1,178 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+#include <mpi.h>
+
+/* Partial sums of the harmonic series, sum 1/n over n in [first, last).
+ *
+ * The index range is cut into blocks of HARMONIC_BLOCK consecutive terms
+ * at fixed positions (multiples of HARMONIC_BLOCK). A block is summed in
+ * a fixed order over eight lanes, two AVX vectors of four, and the block
+ * sums are accumulated in double-double. As long as every
+ * process's range starts and ends on block boundaries, as harmonicRange
+ * arranges, each block is summed the same way for any number of processes
+ * and only the double-double additions are regrouped, so the rounded
+ * result is the same for all process counts. The AVX and scalar paths
+ * perform the same operations in the same order and agree bitwise. */
+
+constexpr std::int64_t HARMONIC_BLOCK = 1 << 12;
+
+/* Unevaluated sum hi + lo of two doubles, added to with error-free
+ * transformations (Knuth's TwoSum) */
+struct Compensated {
+  double hi = 0;
+  double lo = 0;
+
+  void add(double x) {
+    auto s = hi + x;
+    auto b = s - hi;
+    lo += (hi - (s - b)) + (x - b);
+    hi = s;
+  }
+
+  void add(const Compensated &x) {
+    add(x.hi);
+    add(x.lo);
+  }
+
+  double value() const { return hi + lo; }
+};
+
+/* Sum of one block, last - first <= HARMONIC_BLOCK; the indices must be
+ * exact in double, i.e. below 2^53. Division bounds the throughput, so
+ * each lane adds four terms a < b < c < d at a time with one division,
+ *
+ *   1/a + 1/b + 1/c + 1/d = ((a + b) cd + (c + d) ab) / (ab cd),
+ *
+ * which is within a few ulps of the exact group sum, and keeps a Kahan
+ * compensation of its running sum. */
+inline double harmonicBlock(std::int64_t first, std::int64_t last) {
+  constexpr int VECS = 2;
+  constexpr int LANES = 4 * VECS;
+  constexpr int GROUP = 4 * LANES; /* lane j: n + j + LANES * {0, 1, 2, 3} */
+  auto n = first;
+  double lane[LANES] = {};
+  double comp[LANES] = {};
+  if (last - n >= GROUP) {
+#ifdef __AVX__
+    __m256d idx[VECS], acc[VECS], c[VECS];
+    for (int v = 0; v < VECS; ++v) {
+      auto x = static_cast<double>(n + 4 * v);
+      idx[v] = _mm256_setr_pd(x, x + 1, x + 2, x + 3);
+      acc[v] = _mm256_setzero_pd();
+      c[v] = _mm256_setzero_pd();
+    }
+    auto next = _mm256_set1_pd(LANES);
+    auto step = _mm256_set1_pd(GROUP);
+    for (; last - n >= GROUP; n += GROUP)
+      for (int v = 0; v < VECS; ++v) {
+        auto a = idx[v];
+        auto b = _mm256_add_pd(a, next);
+        auto e = _mm256_add_pd(b, next);
+        auto d = _mm256_add_pd(e, next);
+        auto ab = _mm256_mul_pd(a, b);
+        auto ed = _mm256_mul_pd(e, d);
+        auto num = _mm256_add_pd(_mm256_mul_pd(_mm256_add_pd(a, b), ed),
+                                 _mm256_mul_pd(_mm256_add_pd(e, d), ab));
+        auto y = _mm256_sub_pd(_mm256_div_pd(num, _mm256_mul_pd(ab, ed)),
+                               c[v]);
+        auto t = _mm256_add_pd(acc[v], y);
+        c[v] = _mm256_sub_pd(_mm256_sub_pd(t, acc[v]), y);
+        acc[v] = t;
+        idx[v] = _mm256_add_pd(idx[v], step);
+      }
+    for (int v = 0; v < VECS; ++v) {
+      _mm256_storeu_pd(lane + 4 * v, acc[v]);
+      _mm256_storeu_pd(comp + 4 * v, c[v]);
+    }
+#else
+    for (; last - n >= GROUP; n += GROUP)
+      for (int j = 0; j < LANES; ++j) {
+        auto a = static_cast<double>(n + j);
+        auto b = a + LANES;
+        auto e = b + LANES;
+        auto d = e + LANES;
+        auto ab = a * b;
+        auto ed = e * d;
+        auto y = ((a + b) * ed + (e + d) * ab) / (ab * ed) - comp[j];
+        auto t = lane[j] + y;
+        comp[j] = (t - lane[j]) - y;
+        lane[j] = t;
+      }
+#endif
+  }
+
+  Compensated sum{};
+  for (int j = 0; j < LANES; ++j) {
+    sum.add(lane[j]);
+    sum.add(-comp[j]);
+  }
+  for (; n < last; ++n)
+    sum.add(1.0 / static_cast<double>(n));
+  return sum.value();
+}
+
+/* sum 1/n over [first, last), block by block */
+inline Compensated harmonicSum(std::int64_t first, std::int64_t last) {
+  Compensated sum{};
+  while (first < last) {
+    auto blockEnd = std::min(last, (first / HARMONIC_BLOCK + 1) *
+                                       HARMONIC_BLOCK);
+    sum.add(harmonicBlock(first, blockEnd));
+    first = blockEnd;
+  }
+  return sum;
+}
+
+/* Part [first, last) of [1, N] for part of parts: contiguous, as equal as
+ * whole blocks allow, and cut only at block boundaries */
+inline std::pair<std::int64_t, std::int64_t>
+harmonicRange(std::int64_t N, int parts, int part) {
+  auto blocks = N / HARMONIC_BLOCK + 1;
+  auto cut = [&](int p) {
+    return std::clamp<std::int64_t>(blocks * p / parts * HARMONIC_BLOCK, 1,
+                                    N + 1);
+  };
+  return {cut(part), cut(part + 1)};
+}
+
+/* MPI datatype and sum operation for Compensated, created on first use */
+inline MPI::Datatype compensatedType() {
+  static auto type = [] {
+    auto t = MPI::DOUBLE.Create_contiguous(2);
+    t.Commit();
+    return t;
+  }();
+  return type;
+}
+
+inline MPI::Op compensatedSum() {
+  static auto op = [] {
+    MPI::Op o{};
+    o.Init(
+        [](const void *in, void *inout, int len, const MPI::Datatype &) {
+          auto *x = static_cast<const Compensated *>(in);
+          auto *y = static_cast<Compensated *>(inout);
+          for (int i = 0; i < len; ++i)
+            y[i].add(x[i]);
+        },
+        true);
+    return o;
+  }();
+  return op;
+}
+
+/* Sum of every process's part on root */
+inline double reduceHarmonic(const Compensated &part, int root,
+                             const MPI::Intracomm &comm) {
+  Compensated total{};
+  comm.Reduce(&part, &total, 1, compensatedType(), compensatedSum(), root);
+  return total.value();
+}
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <string_view>
+
+#include <mpi.h>
+
+#include "harmonic.hh"
+#include "topology.hh"
+
+/* H_N = sum 1/n over [1, N] for N up to 2^128 - 1.
+ *   exact  - every term by the kernel of harmonic.hh, which needs N < 2^53
+ *   hybrid - terms [1, M] by the kernel, the rest by the Euler-Maclaurin
+ *            expansion
+ *
+ *              H_n = ln n + gamma + 1/(2n) - sum_k B_2k / (2k n^2k),
+ *
+ *            whose error is below the first term left out, so that
+ *            H_N - H_M is known to within twice that term at n = M. The
+ *            cutoff M is the smallest one that meets the tolerance. */
+
+using HarmonicIndex = unsigned __int128;
+
+/* N - 1 for which the kernel's indices are still exact in double */
+constexpr HarmonicIndex HARMONIC_EXACT_MAX = HarmonicIndex{1} << 53;
+
+enum class HarmonicEngine { Exact, Hybrid };
+
+struct HarmonicOptions {
+  HarmonicIndex N = 0;
+  HarmonicEngine engine = HarmonicEngine::Exact;
+  double tol = 1e-16;        /* bound on the tail's truncation error */
+  std::int64_t cutoff = 0;   /* M for hybrid, 0 to derive it from tol */
+};
+
+struct HarmonicResult {
+  double sum;
+  double bound; /* on |sum - H_N|: truncation plus rounding */
+};
+
+/* Decimal digits, optionally followed by e and a decimal exponent */
+inline bool parseIndex(std::string_view s, HarmonicIndex &N) {
+  auto e = std::min(s.find_first_of("eE"), s.size());
+  auto digits = s.substr(0, e);
+  if (digits.empty())
+    return false;
+
+  constexpr auto MAX = ~HarmonicIndex{0};
+  HarmonicIndex x = 0;
+  auto push = [&x](unsigned digit) {
+    if (x > (MAX - digit) / 10)
+      return false;
+    x = 10 * x + digit;
+    return true;
+  };
+  for (auto c : digits)
+    if (c < '0' || c > '9' || !push(c - '0'))
+      return false;
+  if (e < s.size()) {
+    auto exp = s.substr(e + 1);
+    if (exp.empty() || exp.size() > 2)
+      return false;
+    for (auto c : exp)
+      if (c < '0' || c > '9')
+        return false;
+    for (int i = std::atoi(std::string{exp}.c_str()); i > 0; --i)
+      if (!push(0))
+        return false;
+  }
+  N = x;
+  return true;
+}
+
+inline std::string indexString(HarmonicIndex N) {
+  std::string s{};
+  do {
+    s.insert(s.begin(), '0' + static_cast<int>(N % 10));
+    N /= 10;
+  } while (N != 0);
+  return s;
+}
+
+/* av[first] is N, the rest are --engine exact|hybrid, --tol eps,
+ * --cutoff M and whatever pairs extra(arg, val) accepts */
+template <typename Extra>
+bool parseHarmonicOptions(int ac, char **av, int first,
+                          HarmonicOptions &opts, Extra extra) {
+  if (first >= ac || !parseIndex(av[first], opts.N))
+    return false;
+  for (int i = first + 1; i < ac; ++i) {
+    std::string_view arg = av[i];
+    if (i + 1 == ac)
+      return false;
+    std::string_view val = av[++i];
+    if (arg == "--engine" && (val == "exact" || val == "hybrid"))
+      opts.engine =
+          (val == "exact") ? HarmonicEngine::Exact : HarmonicEngine::Hybrid;
+    else if (arg == "--tol")
+      opts.tol = std::atof(av[i]);
+    else if (arg == "--cutoff")
+      opts.cutoff = std::atoll(av[i]);
+    else if (!extra(arg, val))
+      return false;
+  }
+  if (opts.engine == HarmonicEngine::Exact)
+    return opts.N < HARMONIC_EXACT_MAX;
+  return opts.tol > 0 && opts.cutoff >= 0 &&
+         static_cast<HarmonicIndex>(opts.cutoff) < HARMONIC_EXACT_MAX;
+}
+
+inline bool parseHarmonicOptions(int ac, char **av, int first,
+                                 HarmonicOptions &opts) {
+  return parseHarmonicOptions(ac, av, first, opts,
+                              [](std::string_view, std::string_view) {
+                                return false;
+                              });
+}
+
+constexpr const char *HARMONIC_USAGE =
+    "N [--engine exact|hybrid] [--tol eps] [--cutoff M]\n"
+    "N is an integer below 2^128, e.g. 1e30; exact needs N < 2^53";
+
+/* B_2k / (2k) for k = 1..4, and |B_10| / 10, which bounds the error */
+constexpr long double EM_COEF[] = {1.0L / 12, -1.0L / 120, 1.0L / 252,
+                                   -1.0L / 240};
+constexpr long double EM_NEXT = 5.0L / 66 / 10;
+
+/* Bound on the error of H_N - H_M by the expansion, N > M */
+inline long double tailBound(std::int64_t M) {
+  return 2 * EM_NEXT / std::pow(static_cast<long double>(M), 10);
+}
+
+/* H_N - H_M by the expansion */
+inline long double harmonicTail(std::int64_t M, HarmonicIndex N) {
+  auto m = static_cast<long double>(M);
+  auto n = static_cast<long double>(N);
+  auto res = std::log(n / m) + 1 / (2 * n) - 1 / (2 * m);
+  auto m2 = 1 / (m * m);
+  auto n2 = 1 / (n * n);
+  auto mk = m2;
+  auto nk = n2;
+  for (auto coef : EM_COEF) {
+    res -= coef * (nk - mk);
+    mk *= m2;
+    nk *= n2;
+  }
+  return res;
+}
+
+/* Smallest cutoff of at least 16 whose tail bound meets tol */
+inline std::int64_t hybridCutoff(double tol) {
+  std::int64_t M = 16;
+  while (tailBound(M) > tol)
+    M *= 2;
+  return M;
+}
+
+/* Sum of every process's part on rank 0 of the topology's communicator,
+ * added up within each node first */
+inline double reduceHarmonic(const Compensated &part, Topology &topo) {
+  auto add = [](Compensated &acc, const Compensated &x) { acc.add(x); };
+  return reduceHierarchical(part, add, compensatedType(), compensatedSum(),
+                            topo)
+      .value();
+}
+
+/* End of the terms summed one by one: N + 1, or the cutoff + 1 if the
+ * hybrid engine leaves a tail */
+inline std::int64_t harmonicHeadEnd(const HarmonicOptions &opts) {
+  if (opts.engine == HarmonicEngine::Hybrid) {
+    auto M = opts.cutoff ? opts.cutoff : hybridCutoff(opts.tol);
+    if (opts.N > static_cast<HarmonicIndex>(M))
+      return M + 1;
+  }
+  return static_cast<std::int64_t>(opts.N) + 1;
+}
+
+/* H_N from the sum of the terms before harmonicHeadEnd(opts) */
+inline HarmonicResult harmonicFinish(const HarmonicOptions &opts,
+                                     double head) {
+  constexpr auto EPS = std::numeric_limits<double>::epsilon();
+  auto last = harmonicHeadEnd(opts) - 1;
+  if (static_cast<HarmonicIndex>(last) == opts.N)
+    return {head, head * EPS};
+  auto sum = static_cast<double>(head + harmonicTail(last, opts.N));
+  return {sum, static_cast<double>(tailBound(last)) + sum * EPS};
+}
+
+/* H_N on rank 0 of the topology's communicator, the terms up to N (exact)
+ * or to the cutoff (hybrid) summed by all its processes */
+inline HarmonicResult harmonicDistributed(const HarmonicOptions &opts,
+                                          Topology &topo) {
+  auto &comm = topo.comm();
+  auto [first, end] = harmonicRange(harmonicHeadEnd(opts) - 1,
+                                    comm.Get_size(), comm.Get_rank());
+  return harmonicFinish(opts, reduceHarmonic(harmonicSum(first, end), topo));
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstring>
+#include <vector>
+
+#include <mpi.h>
+
+/* Communicators describing where the processes of a communicator run:
+ *   node    - the processes sharing memory with this one (one node)
+ *   leaders - the lowest rank of every node, COMM_NULL on the others
+ *   cart    - nodes x processes per node grid when all the nodes hold the
+ *             same number of processes, a balanced grid otherwise
+ * Ranks keep their order in all of them, so rank 0 of comm is rank 0 of
+ * its node and of the leaders.
+ *
+ * Reductions over a Topology go through shared memory inside a node and
+ * through MPI only among the leaders, one message per node instead of one
+ * per process. Splitting by shared memory and shared windows are MPI-3 and
+ * have no C++ bindings, so they go through the C API. */
+
+/* Largest element reduceHierarchical handles */
+constexpr int TOPOLOGY_SLOT = 64;
+
+/* Processes of comm sharing memory with this one, i.e. on the same node */
+inline MPI::Intracomm nodeComm(const MPI::Intracomm &comm) {
+  MPI_Comm node;
+  MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, comm.Get_rank(),
+                      MPI_INFO_NULL, &node);
+  return node;
+}
+
+/* Root alone and all the other processes, each in a communicator of its
+ * own, ranks in order */
+inline MPI::Intracomm splitRoot(const MPI::Intracomm &comm, int root) {
+  auto rank = comm.Get_rank();
+  return comm.Split(rank != root, rank);
+}
+
+class Topology {
+public:
+  explicit Topology(const MPI::Intracomm &comm)
+      : comm_(comm), node_(nodeComm(comm)) {
+    auto isLeader = (node_.Get_rank() == 0);
+    leaders_ = comm.Split(isLeader ? 0 : MPI::UNDEFINED, comm.Get_rank());
+    nodes_ = isLeader ? leaders_.Get_size() : 0;
+    node_.Bcast(&nodes_, 1, MPI::INT, 0);
+
+    /* Uniform nodes if the largest is no larger than the average */
+    int nodeSize = node_.Get_size();
+    int maxNodeSize = 0;
+    comm.Allreduce(&nodeSize, &maxNodeSize, 1, MPI::INT, MPI::MAX);
+    int dims[2] = {nodes_, maxNodeSize};
+    if (nodes_ * maxNodeSize != comm.Get_size()) {
+      dims[0] = dims[1] = 0;
+      MPI::Compute_dims(comm.Get_size(), 2, dims);
+    }
+    bool periods[2] = {false, false};
+    cart_ = comm.Create_cart(2, dims, periods, false);
+
+    /* One slot per process of the node, all in the leader's segment */
+    MPI_Win_allocate_shared(isLeader ? nodeSize * TOPOLOGY_SLOT : 0,
+                            TOPOLOGY_SLOT, MPI_INFO_NULL, node_, &slots_,
+                            &slotWin_);
+    MPI_Aint size;
+    int dispUnit;
+    MPI_Win_shared_query(slotWin_, 0, &size, &dispUnit, &slots_);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, slotWin_);
+  }
+
+  Topology(const Topology &) = delete;
+  Topology &operator=(const Topology &) = delete;
+
+  ~Topology() {
+    MPI_Win_unlock_all(slotWin_);
+    MPI_Win_free(&slotWin_);
+    cart_.Free();
+    if (leaders_ != MPI::COMM_NULL)
+      leaders_.Free();
+    node_.Free();
+  }
+
+  const MPI::Intracomm &comm() const { return comm_; }
+  const MPI::Intracomm &node() const { return node_; }
+  const MPI::Intracomm &leaders() const { return leaders_; }
+  const MPI::Cartcomm &cart() const { return cart_; }
+  bool isLeader() const { return node_.Get_rank() == 0; }
+  int nodes() const { return nodes_; }
+
+  /* Every process's local value of the node, in node rank order, on the
+   * node's leader; empty elsewhere */
+  template <typename T> std::vector<T> gatherNode(const T &local) {
+    static_assert(sizeof(T) <= TOPOLOGY_SLOT);
+    auto nodeRank = node_.Get_rank();
+    std::memcpy(slots_ + nodeRank * TOPOLOGY_SLOT, &local, sizeof(T));
+    MPI_Win_sync(slotWin_);
+    node_.Barrier();
+    MPI_Win_sync(slotWin_);
+
+    std::vector<T> values(nodeRank == 0 ? node_.Get_size() : 0);
+    for (std::size_t i = 0; i < values.size(); ++i)
+      std::memcpy(&values[i], slots_ + i * TOPOLOGY_SLOT, sizeof(T));
+    /* The slots are free again once the leader has read them */
+    node_.Barrier();
+    return values;
+  }
+
+private:
+  const MPI::Intracomm &comm_;
+  MPI::Intracomm node_;
+  MPI::Intracomm leaders_{};
+  MPI::Cartcomm cart_{};
+  int nodes_ = 0;
+  char *slots_ = nullptr;
+  MPI_Win slotWin_{};
+};
+
+/* Reduction of every process's local value to rank 0 of the topology's
+ * communicator: combine(acc, x) over the node in rank order through shared
+ * memory, then Reduce with op among the leaders. The result is significant
+ * on rank 0 only. */
+template <typename T, typename Combine>
+T reduceHierarchical(const T &local, Combine combine,
+                     const MPI::Datatype &type, const MPI::Op &op,
+                     Topology &topo) {
+  auto values = topo.gatherNode(local);
+  T nodeSum{};
+  for (auto &x : values)
+    combine(nodeSum, x);
+
+  T total{};
+  if (topo.isLeader())
+    topo.leaders().Reduce(&nodeSum, &total, 1, type, op, 0);
+  return total;
+}
@@ -0,0 +1,88 @@
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <omp.h>
+
+#include "palindromes.hpp"
+
+// Runs every back-end on the same input, checks that they agree and reports
+// the best time of several runs together with the throughput.
+int main(int argc, char** argv) {
+    InputOptions opts;
+    int numThreads = omp_get_max_threads();
+    int repeat = 3;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            numThreads = std::atoi(argv[++i]);
+        } else if (arg == "--repeat" && i + 1 < argc) {
+            repeat = std::atoi(argv[++i]);
+        } else if (!parseInputArg(arg, opts)) {
+            std::cerr << "Usage: " << argv[0] << " [--threads N] [--repeat R] " << inputUsage()
+                      << std::endl;
+            return 1;
+        }
+    }
+    if (numThreads < 1 || repeat < 1) {
+        std::cerr << "Thread and repeat counts must be positive" << std::endl;
+        return 1;
+    }
+
+    std::string input;
+    if (!readInput(opts, input)) {
+        std::cerr << "Error opening file!" << std::endl;
+        return 1;
+    }
+
+    NormalizedText normalized;
+    if (opts.textMode) {
+        double bestTime = 0;
+        for (int r = 0; r < repeat; ++r) {
+            double startTime = omp_get_wtime();
+            normalized = normalizeText(input, opts.normalize, numThreads);
+            double time = omp_get_wtime() - startTime;
+            bestTime = (r == 0) ? time : std::min(bestTime, time);
+        }
+        std::cout << "normalize: " << normalized.text.size() << " code points, "
+                  << input.size() / bestTime / 1e6 << " MB/s" << std::endl;
+    }
+
+    std::cout << "Input: " << opts.filename << ", " << input.size() << " bytes, " << numThreads
+              << " threads" << std::endl;
+    std::cout << std::left << std::setw(10) << "backend" << std::right << std::setw(12) << "count"
+              << std::setw(12) << "longest" << std::setw(12) << "time, ms" << std::setw(12) << "MB/s"
+              << std::endl;
+
+    bool agree = true;
+    PalindromeStats reference;
+    for (Backend backend : kAllBackends) {
+        PalindromeStats stats;
+        double bestTime = 0;
+        for (int r = 0; r < repeat; ++r) {
+            double startTime = omp_get_wtime();
+            if (opts.textMode)
+                stats = analyzePalindromes(normalized.text.data(), normalized.text.size(), backend,
+                                           numThreads);
+            else
+                stats = analyzePalindromes(input.data(), input.size(), backend, numThreads);
+            double time = omp_get_wtime() - startTime;
+            bestTime = (r == 0) ? time : std::min(bestTime, time);
+        }
+
+        if (backend == kAllBackends[0]) reference = stats;
+        bool same = stats == reference;
+        agree = agree && same;
+
+        std::cout << std::left << std::setw(10) << backendName(backend) << std::right
+                  << std::setw(12) << stats.count << std::setw(12)
+                  << stats.longestEnd - stats.longestBegin << std::setw(12) << std::fixed
+                  << std::setprecision(2) << bestTime * 1e3 << std::setw(12)
+                  << input.size() / bestTime / 1e6 << (same ? "" : "  MISMATCH") << std::endl;
+    }
+
+    if (!agree) {
+        std::cerr << "Back-ends disagree" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -1,65 +1,57 @@
 #include <iostream>
-#include <cstring>
-#include <fstream>
+#include <tuple>
 #include <omp.h>
 
-size_t countPalindromesFromCenter(const char* str, size_t n, size_t left, size_t right) {
-    size_t count = 0;
-    // Expand outwards as long as we are within bounds and characters match
-    while (left < n && right < n && str[left] == str[right]) {
-        count++;
-        if (left == 0) break;
-        left--;
-        right++;
+#include "palindromes.hpp"
+
+int main(int argc, char** argv) {
+    InputOptions opts;
+    Backend backend = Backend::OpenMP;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--backend" && i + 1 < argc && parseBackend(argv[i + 1], backend)) {
+            ++i;
+            continue;
+        }
+        if (!parseInputArg(arg, opts)) {
+            std::cerr << "Usage: " << argv[0] << " [--backend serial|openmp|thread|manacher] "
+                      << inputUsage() << std::endl;
+            return 1;
+        }
     }
-    return count;
-}
-
-size_t countAllPalindromes(const char* str, size_t n, int numThreads) {
-    if (!str) return 0;
-    size_t totalCount = 0;
-
-    omp_set_num_threads(numThreads);
-
-#pragma omp parallel for reduction(+:totalCount) schedule(dynamic, 100000)
-for (size_t i = 0; i < n; ++i) {
-    totalCount += countPalindromesFromCenter(str, n, i, i);  // Odd-length palindromes
-    totalCount += countPalindromesFromCenter(str, n, i, i + 1);  // Even-length palindromes
-}
-
-return totalCount;
-}
-
-int main() {
-    std::string filename = "war-and-peace";  
 
-    std::ifstream inputFile(filename);
-    if (!inputFile) {
+    std::string input;
+    if (!readInput(opts, input)) {
         std::cerr << "Error opening file!" << std::endl;
         return 1;
     }
 
-    std::string input;
-    std::string line;
-    while (std::getline(inputFile, line)) {
-        input += line;
-    }
-    inputFile.close();
-
-    const char* inputStr = input.c_str();
-    size_t inputLength = input.length();
-
     int numThreads;
     std::cout << "Number of used threads: ";
     std::cin >> numThreads;
 
     double startTime = omp_get_wtime();
 
-    size_t palindromeCount = countAllPalindromes(inputStr, inputLength, numThreads);
+    PalindromeStats stats;
+    NormalizedText normalized;
+    if (opts.textMode) {
+        normalized = normalizeText(input, opts.normalize, numThreads);
+        stats = analyzePalindromes(normalized.text.data(), normalized.text.size(), backend, numThreads);
+    } else {
+        stats = analyzePalindromes(input.data(), input.size(), backend, numThreads);
+    }
 
     double endTime = omp_get_wtime();
 
-    std::cout << "Total number of palindromes: " << palindromeCount << std::endl;
+    size_t begin = stats.longestBegin, end = stats.longestEnd;
+    if (opts.textMode) {
+        std::cout << "Code points: " << normalized.text.size() << std::endl;
+        std::tie(begin, end) = normalized.sourceRange(input, begin, end);
+    }
+
+    std::cout << "Total number of palindromes: " << stats.count << std::endl;
+    std::cout << "Longest palindrome: bytes [" << begin << ", " << end << "): \""
+              << std::string_view(input).substr(begin, end - begin) << "\"" << std::endl;
     std::cout << "Execution time: " << (endTime - startTime) * 1e6 << " microseconds" << std::endl;
 
     return 0;
@@ -0,0 +1,264 @@
+#include "normalize.hpp"
+
+#include <algorithm>
+#include <omp.h>
+
+namespace {
+
+enum class CharClass { Word, Space, Punct };
+
+struct Decoded {
+    char32_t cp;
+    std::size_t len;
+};
+
+constexpr char32_t kReplacement = 0xFFFD;
+
+// Bytes handled per step of the ASCII fast path
+constexpr std::size_t kBlock = 32;
+
+// Do not split the input into chunks smaller than this
+constexpr std::size_t kMinChunk = 1 << 16;
+
+bool isContinuation(unsigned char c) { return (c & 0xC0) == 0x80; }
+
+// Decode one code point at pos. Overlong forms, surrogates, values above
+// U+10FFFF and truncated sequences decode to U+FFFD consuming a single byte.
+Decoded decodeUtf8(const unsigned char* s, std::size_t pos, std::size_t n) {
+    unsigned char c = s[pos];
+    if (c < 0x80) return {c, 1};
+
+    std::size_t len = 0;
+    char32_t cp = 0;
+    unsigned char lo = 0x80, hi = 0xBF;  // allowed range of the second byte
+    if (c >= 0xC2 && c <= 0xDF) {
+        len = 2;
+        cp = c & 0x1F;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        len = 3;
+        cp = c & 0x0F;
+        if (c == 0xE0) lo = 0xA0;
+        if (c == 0xED) hi = 0x9F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        len = 4;
+        cp = c & 0x07;
+        if (c == 0xF0) lo = 0x90;
+        if (c == 0xF4) hi = 0x8F;
+    } else {
+        return {kReplacement, 1};
+    }
+
+    if (pos + len > n || s[pos + 1] < lo || s[pos + 1] > hi) return {kReplacement, 1};
+    for (std::size_t i = 1; i < len; ++i) {
+        if (!isContinuation(s[pos + i])) return {kReplacement, 1};
+        cp = (cp << 6) | (s[pos + i] & 0x3F);
+    }
+    return {cp, len};
+}
+
+CharClass classifyAscii(unsigned char c) {
+    if (c <= ' ' || c == 0x7F) return CharClass::Space;
+    if ((c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z')) return CharClass::Word;
+    return CharClass::Punct;
+}
+
+CharClass classify(char32_t c) {
+    if (c < 0x80) return classifyAscii(static_cast<unsigned char>(c));
+    if (c < 0xA0 || c == 0xA0 || c == 0x1680 || (c >= 0x2000 && c <= 0x200B) || c == 0x2028 ||
+        c == 0x2029 || c == 0x202F || c == 0x205F || c == 0x3000 || c == 0xFEFF)
+        return CharClass::Space;
+    // Latin-1 punctuation and symbols, keeping ordinal indicators, micro
+    // sign, superscript digits and vulgar fractions as word characters
+    if (c <= 0xBF)
+        return (c == 0xAA || c == 0xB2 || c == 0xB3 || c == 0xB5 || c == 0xB9 || c == 0xBA ||
+                c >= 0xBC)
+                   ? CharClass::Word
+                   : CharClass::Punct;
+    if (c == 0xD7 || c == 0xF7) return CharClass::Punct;
+    // General punctuation, currency, arrows/math/technical/box drawing/shapes,
+    // CJK punctuation and the replacement character
+    if ((c >= 0x2010 && c <= 0x2027) || (c >= 0x2030 && c <= 0x205E) ||
+        (c >= 0x20A0 && c <= 0x20CF) || (c >= 0x2190 && c <= 0x2BFF) ||
+        (c >= 0x3001 && c <= 0x303F) || c == kReplacement)
+        return CharClass::Punct;
+    return CharClass::Word;
+}
+
+char32_t foldAscii(char32_t c) { return c + (c - 'A' < 26u ? 0x20 : 0); }
+
+// Simple one-to-one lower case mapping for the Latin, Greek and Cyrillic
+// blocks; other scripts are left untouched.
+char32_t fold(char32_t c) {
+    if (c < 0x80) return foldAscii(c);
+    if (c >= 0xC0 && c <= 0xDE && c != 0xD7) return c + 0x20;
+    if (c >= 0x100 && c <= 0x17F) {
+        if (c == 0x178) return 0xFF;
+        if (c == 0x130) return 'i';
+        bool evenUpper = (c <= 0x137) || (c >= 0x14A && c <= 0x177);
+        bool oddUpper = (c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17E);
+        if ((evenUpper && c % 2 == 0) || (oddUpper && c % 2 == 1)) return c + 1;
+        return c;
+    }
+    if (c >= 0x386 && c <= 0x3AB) {
+        if (c == 0x386) return 0x3AC;
+        if (c >= 0x388 && c <= 0x38A) return c + 37;
+        if (c == 0x38C) return 0x3CC;
+        if (c == 0x38E || c == 0x38F) return c + 63;
+        if (c >= 0x391 && c != 0x3A2) return c + 0x20;
+        return c;
+    }
+    if (c >= 0x400 && c <= 0x40F) return c + 0x50;
+    if (c >= 0x410 && c <= 0x42F) return c + 0x20;
+    if (((c >= 0x460 && c <= 0x481) || (c >= 0x48A && c <= 0x4BF)) && c % 2 == 0) return c + 1;
+    return c;
+}
+
+bool keep(CharClass cls, const NormalizeOptions& opts) {
+    return !(cls == CharClass::Punct && opts.stripPunct) &&
+           !(cls == CharClass::Space && opts.stripSpace);
+}
+
+// Number of code points kept from kBlock ASCII bytes starting at p.
+std::size_t asciiBlockCount(const unsigned char* p, const NormalizeOptions& opts) {
+    if (!opts.stripPunct && !opts.stripSpace) return kBlock;
+
+    std::size_t k = 0;
+#pragma omp simd reduction(+ : k)
+    for (std::size_t j = 0; j < kBlock; ++j) {
+        char32_t c = p[j];
+        char32_t low = c | 0x20;
+        bool word = (c - '0' < 10u) || (low - 'a' < 26u);
+        bool space = c <= ' ' || c == 0x7F;
+        bool drop = (opts.stripSpace && space) || (opts.stripPunct && !word && !space);
+        k += !drop;
+    }
+    return k;
+}
+
+// Processes kBlock ASCII bytes starting at pos; out/offs receive at most
+// kBlock entries. Without filtering the loop carries no branches and
+// vectorizes.
+std::size_t asciiBlock(const unsigned char* s, std::size_t pos, const NormalizeOptions& opts,
+                       char32_t* out, std::size_t* offs) {
+    const unsigned char* p = s + pos;
+    char32_t foldMask = opts.foldCase ? 0x20 : 0;
+
+    if (!opts.stripPunct && !opts.stripSpace) {
+#pragma omp simd
+        for (std::size_t j = 0; j < kBlock; ++j) {
+            char32_t c = p[j];
+            out[j] = c | ((c - 'A' < 26u) ? foldMask : 0);
+            offs[j] = pos + j;
+        }
+        return kBlock;
+    }
+
+    std::size_t k = 0;
+    for (std::size_t j = 0; j < kBlock; ++j) {
+        char32_t c = p[j];
+        char32_t low = c | 0x20;
+        bool word = (c - '0' < 10u) || (low - 'a' < 26u);
+        bool space = c <= ' ' || c == 0x7F;
+        bool drop = (opts.stripSpace && space) || (opts.stripPunct && !word && !space);
+        // Writing only kept entries keeps each chunk inside its own slice of
+        // the shared output buffer
+        if (!drop) {
+            out[k] = c | ((c - 'A' < 26u) ? foldMask : 0);
+            offs[k] = pos + j;
+            ++k;
+        }
+    }
+    return k;
+}
+
+bool isAsciiBlock(const unsigned char* p) {
+    unsigned char high = 0;
+#pragma omp simd reduction(| : high)
+    for (std::size_t j = 0; j < kBlock; ++j) high |= p[j];
+    return (high & 0x80) == 0;
+}
+
+// Normalizes bytes [begin, end). With out == nullptr only counts the code
+// points that would be written, which sizes the output before the real pass.
+// Every input byte produces at most one code point.
+std::size_t normalizeChunk(const unsigned char* s, std::size_t n, std::size_t begin,
+                           std::size_t end, const NormalizeOptions& opts, char32_t* out,
+                           std::size_t* offs) {
+    std::size_t k = 0;
+    std::size_t pos = begin;
+    while (pos < end) {
+        if (pos + kBlock <= end && isAsciiBlock(s + pos)) {
+            k += out ? asciiBlock(s, pos, opts, out + k, offs + k) : asciiBlockCount(s + pos, opts);
+            pos += kBlock;
+            continue;
+        }
+
+        // Mixed block: decode code point by code point up to its end
+        std::size_t blockEnd = std::min(pos + kBlock, end);
+        while (pos < blockEnd) {
+            auto [cp, len] = decodeUtf8(s, pos, n);
+            if (keep(classify(cp), opts)) {
+                if (out) {
+                    out[k] = opts.foldCase ? fold(cp) : cp;
+                    offs[k] = pos;
+                }
+                ++k;
+            }
+            pos += len;
+        }
+    }
+    return k;
+}
+
+// Chunk borders for numChunks chunks, moved forward past continuation bytes
+// so that no sequence is split. At most three bytes are skipped, which is
+// what a serial decoder would consume, so results do not depend on the
+// number of threads.
+std::vector<std::size_t> splitUtf8(const unsigned char* s, std::size_t n, int numChunks) {
+    std::vector<std::size_t> bounds(numChunks + 1, n);
+    bounds[0] = 0;
+    for (int t = 1; t < numChunks; ++t) {
+        std::size_t b = std::max(bounds[t - 1], n / numChunks * t);
+        for (int skip = 0; skip < 3 && b < n && isContinuation(s[b]); ++skip) ++b;
+        bounds[t] = b;
+    }
+    return bounds;
+}
+
+}  // namespace
+
+std::pair<std::size_t, std::size_t> NormalizedText::sourceRange(std::string_view src,
+                                                                std::size_t first,
+                                                                std::size_t last) const {
+    if (first >= last) return {0, 0};
+    auto* s = reinterpret_cast<const unsigned char*>(src.data());
+    std::size_t lastPos = offsets[last - 1];
+    return {offsets[first], lastPos + decodeUtf8(s, lastPos, src.size()).len};
+}
+
+NormalizedText normalizeText(std::string_view src, const NormalizeOptions& opts, int numThreads) {
+    auto* s = reinterpret_cast<const unsigned char*>(src.data());
+    std::size_t n = src.size();
+
+    int numChunks = static_cast<int>(std::min<std::size_t>(std::max(numThreads, 1), n / kMinChunk + 1));
+    auto bounds = splitUtf8(s, n, numChunks);
+    std::vector<std::size_t> starts(numChunks + 1, 0);
+
+    // Two passes over each chunk: count, then write straight into the
+    // final buffer at the chunk's prefix-sum position
+#pragma omp parallel for num_threads(numChunks) schedule(static, 1)
+    for (int t = 0; t < numChunks; ++t)
+        starts[t + 1] = normalizeChunk(s, n, bounds[t], bounds[t + 1], opts, nullptr, nullptr);
+
+    for (int t = 0; t < numChunks; ++t) starts[t + 1] += starts[t];
+
+    NormalizedText result;
+    result.text.resize(starts[numChunks]);
+    result.offsets.resize(starts[numChunks]);
+
+#pragma omp parallel for num_threads(numChunks) schedule(static, 1)
+    for (int t = 0; t < numChunks; ++t)
+        normalizeChunk(s, n, bounds[t], bounds[t + 1], opts, result.text.data() + starts[t],
+                       result.offsets.data() + starts[t]);
+    return result;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+struct NormalizeOptions {
+    bool foldCase = true;     // map upper case letters to lower case
+    bool stripPunct = false;  // drop punctuation and symbols
+    bool stripSpace = false;  // drop whitespace and control characters
+};
+
+// UTF-8 text decoded into fixed-width code points. offsets[i] is the byte
+// offset in the source buffer where text[i] was read from, so results found
+// on the normalized buffer can be reported against the original file.
+struct NormalizedText {
+    std::vector<char32_t> text;
+    std::vector<std::size_t> offsets;
+
+    // Source byte range [begin, end) covering code points text[first..last).
+    std::pair<std::size_t, std::size_t> sourceRange(std::string_view src, std::size_t first,
+                                                     std::size_t last) const;
+};
+
+// Decode, case-fold and filter src using numThreads OpenMP threads.
+// Malformed UTF-8 sequences are replaced by U+FFFD, one per offending byte.
+NormalizedText normalizeText(std::string_view src, const NormalizeOptions& opts, int numThreads);
@@ -0,0 +1,212 @@
+#include "palindromes.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <vector>
+#include <omp.h>
+
+namespace {
+
+// Centers handed out at once by the dynamic schedules
+constexpr size_t kCenterBlock = 100000;
+
+template <typename CharT>
+size_t countPalindromesFromCenter(const CharT* str, size_t n, size_t left, size_t right) {
+    size_t count = 0;
+    // Expand outwards as long as we are within bounds and characters match
+    while (right < n && str[left] == str[right]) {
+        count++;
+        if (left == 0) break;
+        left--;
+        right++;
+    }
+    return count;
+}
+
+// Keeps the longer palindrome, or the one further left on equal length
+void mergeLongest(PalindromeStats& into, size_t begin, size_t end) {
+    size_t len = end - begin, bestLen = into.longestEnd - into.longestBegin;
+    if (len > bestLen || (len == bestLen && len != 0 && begin < into.longestBegin)) {
+        into.longestBegin = begin;
+        into.longestEnd = end;
+    }
+}
+
+void mergeStats(PalindromeStats& into, const PalindromeStats& part) {
+    into.count += part.count;
+    mergeLongest(into, part.longestBegin, part.longestEnd);
+}
+
+// Expands every center in [from, to). Centers are visited left to right and
+// only strictly longer palindromes replace the best one, which keeps the
+// leftmost longest.
+template <typename CharT>
+void expandCenters(const CharT* str, size_t n, size_t from, size_t to, PalindromeStats& stats) {
+    for (size_t i = from; i < to; ++i) {
+        size_t odd = countPalindromesFromCenter(str, n, i, i);  // Odd-length palindromes
+        size_t even = countPalindromesFromCenter(str, n, i, i + 1);  // Even-length palindromes
+        stats.count += odd + even;
+        if (2 * odd - 1 > stats.longestEnd - stats.longestBegin) {
+            stats.longestBegin = i + 1 - odd;
+            stats.longestEnd = i + odd;
+        }
+        if (2 * even > stats.longestEnd - stats.longestBegin) {
+            stats.longestBegin = i + 1 - even;
+            stats.longestEnd = i + 1 + even;
+        }
+    }
+}
+
+template <typename CharT>
+PalindromeStats analyzeSerial(const CharT* str, size_t n) {
+    PalindromeStats stats;
+    expandCenters(str, n, 0, n, stats);
+    return stats;
+}
+
+template <typename CharT>
+PalindromeStats analyzeOpenMP(const CharT* str, size_t n, int numThreads) {
+    PalindromeStats total;
+    size_t numBlocks = (n + kCenterBlock - 1) / kCenterBlock;
+
+#pragma omp parallel num_threads(numThreads)
+    {
+        PalindromeStats local;
+#pragma omp for schedule(dynamic, 1) nowait
+        for (size_t b = 0; b < numBlocks; ++b)
+            expandCenters(str, n, b * kCenterBlock, std::min(n, (b + 1) * kCenterBlock), local);
+#pragma omp critical
+        mergeStats(total, local);
+    }
+    return total;
+}
+
+template <typename CharT>
+PalindromeStats analyzeStdThread(const CharT* str, size_t n, int numThreads) {
+    size_t numBlocks = (n + kCenterBlock - 1) / kCenterBlock;
+    std::atomic<size_t> nextBlock{0};
+    std::vector<PalindromeStats> partial(numThreads);
+
+    auto worker = [&](int t) {
+        for (size_t b; (b = nextBlock.fetch_add(1, std::memory_order_relaxed)) < numBlocks;)
+            expandCenters(str, n, b * kCenterBlock, std::min(n, (b + 1) * kCenterBlock), partial[t]);
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 1; t < numThreads; ++t) threads.emplace_back(worker, t);
+    worker(0);
+    for (auto& thread : threads) thread.join();
+
+    PalindromeStats total;
+    for (const auto& part : partial) mergeStats(total, part);
+    return total;
+}
+
+// Manacher's algorithm: d1[i] is the number of odd palindromes centered at
+// i, d2[i] the number of even ones centered between i - 1 and i. Linear
+// time, independent of how long the palindromes are.
+template <typename CharT>
+PalindromeStats analyzeManacher(const CharT* str, size_t n) {
+    PalindromeStats stats;
+    std::vector<size_t> d1(n), d2(n);
+
+    for (size_t i = 0, l = 0, r = 0; i < n; ++i) {
+        size_t k = (i >= r) ? 1 : std::min(d1[l + r - 1 - i], r - i);
+        while (i + k < n && k <= i && str[i - k] == str[i + k]) ++k;
+        d1[i] = k;
+        if (i + k > r) l = i + 1 - k, r = i + k;
+    }
+    for (size_t i = 0, l = 0, r = 0; i < n; ++i) {
+        size_t k = (i >= r) ? 0 : std::min(d2[l + r - i], r - i);
+        while (i + k < n && k < i && str[i - k - 1] == str[i + k]) ++k;
+        d2[i] = k;
+        if (i + k > r) l = i - k, r = i + k;
+    }
+
+    // Same visiting order as expandCenters: odd center i, then the even
+    // center between i and i + 1
+    for (size_t i = 0; i < n; ++i) {
+        size_t odd = d1[i];
+        size_t even = (i + 1 < n) ? d2[i + 1] : 0;
+        stats.count += odd + even;
+        if (2 * odd - 1 > stats.longestEnd - stats.longestBegin) {
+            stats.longestBegin = i + 1 - odd;
+            stats.longestEnd = i + odd;
+        }
+        if (2 * even > stats.longestEnd - stats.longestBegin) {
+            stats.longestBegin = i + 1 - even;
+            stats.longestEnd = i + 1 + even;
+        }
+    }
+    return stats;
+}
+
+}  // namespace
+
+const char* backendName(Backend backend) {
+    switch (backend) {
+    case Backend::Serial: return "serial";
+    case Backend::OpenMP: return "openmp";
+    case Backend::StdThread: return "thread";
+    case Backend::Manacher: return "manacher";
+    }
+    return "unknown";
+}
+
+bool parseBackend(std::string_view name, Backend& backend) {
+    for (Backend b : kAllBackends) {
+        if (name == backendName(b)) {
+            backend = b;
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename CharT>
+PalindromeStats analyzePalindromes(const CharT* str, size_t n, Backend backend, int numThreads) {
+    if (!str || n == 0) return {};
+    numThreads = std::max(numThreads, 1);
+
+    switch (backend) {
+    case Backend::Serial: return analyzeSerial(str, n);
+    case Backend::OpenMP: return analyzeOpenMP(str, n, numThreads);
+    case Backend::StdThread: return analyzeStdThread(str, n, numThreads);
+    case Backend::Manacher: return analyzeManacher(str, n);
+    }
+    return {};
+}
+
+template PalindromeStats analyzePalindromes(const char*, size_t, Backend, int);
+template PalindromeStats analyzePalindromes(const char32_t*, size_t, Backend, int);
+
+bool parseInputArg(std::string_view arg, InputOptions& opts) {
+    if (arg == "--text") opts.textMode = true;
+    else if (arg == "--strip-punct") opts.normalize.stripPunct = true;
+    else if (arg == "--strip-space") opts.normalize.stripSpace = true;
+    else if (arg == "--keep-case") opts.normalize.foldCase = false;
+    else if (!arg.empty() && arg[0] != '-') opts.filename = arg;
+    else return false;
+    return true;
+}
+
+const char* inputUsage() { return "[--text [--strip-punct] [--strip-space] [--keep-case]] [file]"; }
+
+bool readInput(const InputOptions& opts, std::string& input) {
+    std::ifstream inputFile(opts.filename, std::ios::binary);
+    if (!inputFile) return false;
+
+    input.clear();
+    if (opts.textMode) {
+        input.assign(std::istreambuf_iterator<char>(inputFile), std::istreambuf_iterator<char>());
+    } else {
+        std::string line;
+        while (std::getline(inputFile, line)) {
+            input += line;  // Append each line (without newlines)
+        }
+    }
+    return true;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include "normalize.hpp"
+
+enum class Backend { Serial, OpenMP, StdThread, Manacher };
+
+inline constexpr Backend kAllBackends[] = {Backend::Serial, Backend::OpenMP, Backend::StdThread,
+                                           Backend::Manacher};
+
+const char* backendName(Backend backend);
+bool parseBackend(std::string_view name, Backend& backend);
+
+struct PalindromeStats {
+    size_t count = 0;         // number of palindromic substrings (by position)
+    size_t longestBegin = 0;  // leftmost longest palindrome is [begin, end)
+    size_t longestEnd = 0;
+
+    bool operator==(const PalindromeStats&) const = default;
+};
+
+// Counts palindromic substrings of str[0..n) and finds the leftmost longest
+// one. All back-ends return identical results; numThreads is ignored by the
+// serial ones. Instantiated for char and char32_t.
+template <typename CharT>
+PalindromeStats analyzePalindromes(const CharT* str, size_t n, Backend backend, int numThreads);
+
+struct InputOptions {
+    std::string filename = "war-and-peace";
+    bool textMode = false;  // normalize UTF-8 text instead of raw bytes
+    NormalizeOptions normalize;
+};
+
+// Consumes one of the shared input arguments; returns false if arg is not one.
+bool parseInputArg(std::string_view arg, InputOptions& opts);
+const char* inputUsage();
+
+// Raw mode joins the lines of the file without newlines; text mode keeps the
+// file verbatim so that normalized offsets point into it.
+bool readInput(const InputOptions& opts, std::string& input);
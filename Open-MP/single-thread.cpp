@@ -1,62 +1,47 @@
 #include <iostream>
-#include <cstring>
 #include <chrono>
-#include <fstream>
+#include <tuple>
 
-size_t countPalindromesFromCenter(const char* str, size_t n, size_t left, size_t right) {
-    size_t count = 0;
+#include "palindromes.hpp"
 
-    while (left >= 0 && right < n && *(str + left) == *(str + right)) {
-        count++;  
-        if (left == 0) break; 
-        left--;  
-        right++; 
+int main(int argc, char** argv) {
+    InputOptions opts;
+    for (int i = 1; i < argc; ++i) {
+        if (!parseInputArg(argv[i], opts)) {
+            std::cerr << "Usage: " << argv[0] << " " << inputUsage() << std::endl;
+            return 1;
+        }
     }
 
-    return count;
-}
-
-size_t countAllPalindromes(const char* str) {
-    if (!str) return 0; 
-
-    size_t n = std::strlen(str);
-    size_t totalCount = 0;
-
-    for (size_t i = 0; i < n; ++i) {
-        totalCount += countPalindromesFromCenter(str, n, i, i);
-        totalCount += countPalindromesFromCenter(str, n, i, i + 1);
-    }
-    return totalCount;
-}
-
-int main() {
-    std::string filename = "war-and-peace";  // Ensure the correct file path
-
-    std::ifstream inputFile(filename);
-    if (!inputFile) {
+    std::string input;
+    if (!readInput(opts, input)) {
         std::cerr << "Error opening file!" << std::endl;
         return 1;
     }
 
-    std::string input;
-    std::string line;
-    
-    // Read the file content line by line and concatenate into a single string
-    while (std::getline(inputFile, line)) {
-        input += line; // Append each line (without newlines)
-    }
-
-    inputFile.close();
-
-    const char* inputStr = input.c_str();
     auto startTime = std::chrono::high_resolution_clock::now();
 
-    size_t palindromeCount = countAllPalindromes(inputStr);
+    PalindromeStats stats;
+    NormalizedText normalized;
+    if (opts.textMode) {
+        normalized = normalizeText(input, opts.normalize, 1);
+        stats = analyzePalindromes(normalized.text.data(), normalized.text.size(), Backend::Serial, 1);
+    } else {
+        stats = analyzePalindromes(input.data(), input.size(), Backend::Serial, 1);
+    }
 
     auto endTime = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime);
 
-    std::cout << "Total number of palindromes: " << palindromeCount << std::endl;
+    size_t begin = stats.longestBegin, end = stats.longestEnd;
+    if (opts.textMode) {
+        std::cout << "Code points: " << normalized.text.size() << std::endl;
+        std::tie(begin, end) = normalized.sourceRange(input, begin, end);
+    }
+
+    std::cout << "Total number of palindromes: " << stats.count << std::endl;
+    std::cout << "Longest palindrome: bytes [" << begin << ", " << end << "): \""
+              << std::string_view(input).substr(begin, end - begin) << "\"" << std::endl;
     std::cout << "Execution time: " << duration.count() << " microseconds" << std::endl;
 
     return 0;